@@ -0,0 +1,127 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "memstats.h"
+
+namespace mygl
+{
+
+// 线性 (bump) 分配器, 用于只活到帧末或者函数返回的临时数据: 分配只是移动指针, 不能单独释放,
+// reset() 一次性回收全部, 不归还内存. 内存按块向系统申请, 块满了开新块, reset 时把多个块合并成一块,
+// 用量稳定之后 (比如渲染了几帧之后) 只剩一块, reset 为 O(1), 不再有任何堆分配.
+// 不是线程安全的, 每帧或者每个线程一个.
+class Arena
+{
+public:
+    explicit Arena(size_t block_bytes = 64 * 1024);
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // align 必须是 2 的幂
+    void *allocate(size_t bytes, size_t align = alignof(std::max_align_t));
+
+    template <class T>
+    T *allocate_array(size_t n)
+    {
+        return static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+    }
+
+    // 回到开头, 之前分配的内存全部作废
+    void reset();
+
+    // 记下当前位置, rewind 时回收之后分配的内存, 可以嵌套 (见 ArenaScope). 回到开头时等于 reset()
+    struct Marker
+    {
+        size_t block;
+        size_t offset;
+    };
+    Marker mark() const { return Marker{current_, offset_}; }
+    void rewind(Marker marker);
+
+    // 当前已分配的字节数 (含对齐填充和块尾放不下而跳过的部分), 以及它的历史最大值
+    size_t used() const;
+    size_t peak() const { return peak_; }
+    // 向系统申请的总字节数
+    size_t capacity() const;
+
+private:
+    struct Block
+    {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+
+    size_t block_bytes_;
+    std::vector<Block> blocks_;
+    memstats::Tracker memory_ = memstats::Tracker(memstats::TRANSIENT);
+    size_t current_;    // 正在使用的块
+    size_t offset_;     // 当前块内已用的字节数
+    size_t peak_;
+};
+
+// 作用域内的临时分配, 离开作用域时回收
+class ArenaScope
+{
+public:
+    explicit ArenaScope(Arena &arena) : arena_(arena), marker_(arena.mark()) {}
+    ~ArenaScope() { arena_.rewind(marker_); }
+
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+private:
+    Arena &arena_;
+    Arena::Marker marker_;
+};
+
+// 当前线程的临时分配器, 配合 ArenaScope 使用
+Arena &threadArena();
+
+// 在 Arena 上分配的标准库分配器, 释放什么也不做. 容器必须在 Arena reset 之前丢弃或者重新构造
+template <class T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+    // 赋值时容器换用新的 Arena, 见 FramePipeline::geometry
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    explicit ArenaAllocator(Arena *arena = nullptr) : arena_(arena) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena())
+    {
+    }
+
+    T *allocate(size_t n) { return arena_->allocate_array<T>(n); }
+    void deallocate(T *, size_t) {}
+
+    Arena *arena() const { return arena_; }
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena_ == other.arena(); }
+    template <class U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return arena_ != other.arena(); }
+
+private:
+    Arena *arena_;
+};
+
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// 全局 operator new / delete 的调用次数和 new 请求的总字节数, 从进程启动开始累计
+struct HeapCounters
+{
+    size_t allocations;
+    size_t frees;
+    size_t bytes;
+};
+
+HeapCounters heapCounters();
+
+} // namespace mygl
@@ -0,0 +1,73 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "texture.h"
+#include "mesh.h"
+
+// 模型引用的三张贴图的路径
+struct MaterialPaths
+{
+    std::string diffuse;
+    std::string specular;
+    std::string normal;
+};
+
+// OBJ 用 mtllib 引用的材质文件中第一个材质的 map_Kd / map_Ks / map_Bump (或 bump, norm), 相对材质文件所在目录;
+// 没有材质文件或者缺少某一项时, 取 OBJ 同目录下的 <名字>_diffuse.tga / <名字>_spec.tga / <名字>_nm.tga
+MaterialPaths resolve_material(const std::string &obj);
+
+
+// 资源管理: 按规范化的路径和加载参数缓存共享的只读资源, 同一个资源只加载一次.
+// 加载在线程池上进行, 调用方先拿到 shared_future, 需要时再等待, 互不依赖的资源可以同时加载.
+// 资源本身由 shared_ptr 的引用计数管理, collect() 释放已经没有使用者的资源.
+class AssetManager
+{
+public:
+    template <class T>
+    using Handle = std::shared_future<std::shared_ptr<const T>>;
+
+    // nthreads 为0时取硬件线程数, 至少两个, 加载时有相当一部分时间在等待 IO
+    explicit AssetManager(size_t nthreads = 0);
+    ~AssetManager();
+    AssetManager(const AssetManager &) = delete;
+    AssetManager &operator=(const AssetManager &) = delete;
+
+    // 进程内默认的实例
+    static AssetManager &shared();
+
+    // 读入TGA后一次性转换成指定的纹理存储布局, 或者压缩. 文件无法读取时得到空贴图.
+    // category 为内存统计中贴图的用途, 同一张贴图按第一次请求时的用途计
+    Handle<Texture> texture(const std::string &path, Texture::Layout layout,
+                            Texture::Compression compression = Texture::UNCOMPRESSED,
+                            memstats::Category category = memstats::TEXTURE);
+    // 文件无法读取时得到 nullptr, 失败的不缓存, 再次请求时重新读取
+    Handle<MeshAsset> mesh(const std::string &path, bool optimize = true);
+
+    // 释放已经加载完成, 并且只被缓存引用的资源, 返回释放的个数
+    size_t collect();
+    // 缓存中的资源个数 (包括正在加载的)
+    size_t size() const;
+
+private:
+    template <class T>
+    Handle<T> load(std::map<std::string, Handle<T>> &cache, const std::string &key,
+                   std::function<std::shared_ptr<const T>()> loader);
+    void worker();
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> tasks_;
+    std::vector<std::thread> threads_;
+    bool stop_;
+
+    std::map<std::string, Handle<Texture>> textures_;
+    std::map<std::string, Handle<MeshAsset>> meshes_;
+};
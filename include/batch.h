@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "model.h"
+#include "render.h"
+
+// 多视图批量渲染: 同一个已加载的模型, 从 N 个相机位姿各渲染一帧 (转台, 相机扫动等).
+// 每个视图有自己的 mygl::View 和帧缓冲, 视图分给多个线程并行渲染, 模型和贴图只读共享.
+// 输出为 output_000.tga, output_001.tga, ... 和对应的 zbuffer_%03d.tga.
+namespace batch
+{
+
+// 位姿文件每行一个相机: eye.x eye.y eye.z [center.x center.y center.z [up.x up.y up.z]],
+// 空行和 # 开头的行忽略. 格式错误或者相机退化 (见 validCamera) 时返回 false, error 为出错的行号
+bool loadPoses(const char *path, std::vector<Camera> &poses, std::string &error);
+
+struct Stats
+{
+    double seconds = 0.0;   // 墙钟时间
+    long faces = 0;
+    size_t failures = 0;
+    size_t threads = 0;     // 实际参与渲染的线程数
+    size_t memory = 0;      // 各线程帧缓冲和输出图像等内存之和的峰值 (字节), 见 memstats::Job
+};
+
+// 用 nthreads 个线程渲染所有位姿, 第 i 个位姿的输出编号为 i.
+// 每个线程一份帧缓冲和输出图像, memory_limit (字节, 0 为不限制) 为它们之和的上限:
+// 分配之前按 frameBytes 估算, 放不下的线程不参与渲染; 一个线程也放不下时所有视图都失败. 模型和贴图不计入
+Stats render(Model &model, const std::vector<Camera> &poses, int width, int height, size_t nthreads,
+             size_t memory_limit = 0);
+
+// tinyRenderer --batch <n | poses.txt> [threads] [memory MB]: n 为数字时渲染 n 个视图的转台
+int run(int argc, char **argv);
+
+} // namespace batch
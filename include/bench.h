@@ -0,0 +1,40 @@
+#pragma once
+
+// 性能测试, 通过 tinyRenderer --bench <name> [args] 运行
+namespace bench
+{
+
+// 不同纹理存储布局在各个旋转角度下的采样耗时
+int textureLayouts(const char *filename);
+
+// 块压缩贴图与未压缩贴图的内存占用和误差, 以及模型按各种方式常驻的贴图内存和片段着色吞吐
+int compressedTextures(const char *filename);
+
+// 快速数学函数在各精度模式下的最大误差和耗时
+int fastMath();
+
+// 原始面顺序与加载时优化后的面顺序的 ACMR 和帧耗时
+int meshOrder(const char *filename);
+
+// 各级 LOD 的误差, 以及不同屏幕尺寸下选中的 LOD 与绘制耗时
+int lodSelection(const char *filename);
+
+// 模型的网格和贴图逐个加载与并行加载的冷启动耗时
+int assetLoading(const char *filename);
+
+// 大三角形, 细长三角形和小三角形的光栅化耗时
+int rasterBlocks();
+
+// 不抗锯齿, 4x MSAA 与 4x SSAA 的耗时, 片段着色次数和画质
+int antialiasing(const char *filename);
+
+// 可变着色率: 整帧 1x1, 2x2, 4x4 和按图像内容自适应时的耗时, 片段着色次数和画质
+int shadingRates(const char *filename, float threshold);
+
+// 多帧流水线预热之后每帧的堆分配次数 (应为 0) 和帧临时数据 Arena 的大小
+int allocations(const char *filename);
+
+// 按名字分派, 返回进程退出码
+int run(int argc, char **argv);
+
+} // namespace bench
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include "image.h"
+
+// BC1/BC4/BC5 风格的 4x4 块压缩.
+// BC1: 8字节, 两个 RGB565 端点 + 16个2位索引, 用于颜色;
+// BC4: 8字节, 两个8位端点 + 16个3位索引, 用于单通道;
+// BC5: 16字节, 两个 BC4 块, 用于法线的 x/y 两个分量.
+// 解码只取块中的一个纹素, 采样器不需要解出整个块.
+namespace blockcompress
+{
+
+// texels 为块内按行排列的16个纹素, 块外的部分由调用方用边缘纹素补齐
+void encode_bc1(const TGAColor texels[16], unsigned char out[8]);
+void encode_bc4(const unsigned char values[16], unsigned char out[8]);
+void encode_bc5(const unsigned char x[16], const unsigned char y[16], unsigned char out[16]);
+
+inline TGAColor rgb565(uint16_t c)
+{
+    unsigned char r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    return TGAColor((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+// i 为纹素在块内的下标 (y * 4 + x)
+inline TGAColor decode_bc1(const unsigned char *block, int i)
+{
+    uint16_t c0 = block[0] | (block[1] << 8);
+    uint16_t c1 = block[2] | (block[3] << 8);
+    int idx = (block[4 + (i >> 2)] >> ((i & 3) * 2)) & 3;
+    if (idx == 0)
+        return rgb565(c0);
+    if (idx == 1)
+        return rgb565(c1);
+
+    TGAColor a = rgb565(c0), b = rgb565(c1);
+    if (c0 > c1)
+    {
+        int wa = idx == 2 ? 2 : 1;
+        int wb = 3 - wa;
+        return TGAColor((a.r * wa + b.r * wb) / 3, (a.g * wa + b.g * wb) / 3, (a.b * wa + b.b * wb) / 3);
+    }
+    if (idx == 2)
+        return TGAColor((a.r + b.r) / 2, (a.g + b.g) / 2, (a.b + b.b) / 2);
+    return TGAColor(0, 0, 0);
+}
+
+inline unsigned char decode_bc4(const unsigned char *block, int i)
+{
+    int e0 = block[0], e1 = block[1];
+    uint64_t bits = 0;
+    memcpy(&bits, block + 2, 6);
+    int idx = int((bits >> (3 * i)) & 7);
+    if (idx == 0)
+        return e0;
+    if (idx == 1)
+        return e1;
+    if (e0 > e1)
+        return (unsigned char)(((8 - idx) * e0 + (idx - 1) * e1) / 7);
+    if (idx == 6)
+        return 0;
+    if (idx == 7)
+        return 255;
+    return (unsigned char)(((6 - idx) * e0 + (idx - 1) * e1) / 5);
+}
+
+} // namespace blockcompress
@@ -0,0 +1,245 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "geometry.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 着色用的快速数学函数: exp2, log2, pow, 倒数平方根, normalize, clamp.
+// 精度由 Accuracy 选择, 默认值由编译选项 FASTMATH_ACCURACY 决定 (0 EXACT, 1 FAST, 2 FASTEST).
+// 在 x86-64 上用 tinyRenderer --bench fastmath 测得的最大相对误差和 pow 每个值的耗时:
+//            exp2      log2 (|x-1| > 1e-3)   pow (结果 > 1e-6)   rsqrt      pow 标量   pow SIMD
+//   EXACT    -         -                      -                   -          12.5 ns    15.9 ns
+//   FAST     2.2e-7    8.5e-6                 1.1e-4              2.6e-7     13.8 ns     3.9 ns
+//   FASTEST  7.7e-5    4.0e-4                 5.4e-3              1.8e-3     10.3 ns     4.4 ns
+// EXACT 直接调用标准库. 标量的 FAST pow 比 std::pow 快不了 (两次多项式求值加上位操作),
+// 只有 SIMD 形式一次算四个值才划算, 所以逐片段的标量路径 (GouraudShader::fragment) 用 EXACT.
+namespace fastmath
+{
+
+enum class Accuracy
+{
+    EXACT,
+    FAST,
+    FASTEST
+};
+
+#ifndef FASTMATH_ACCURACY
+#define FASTMATH_ACCURACY 1
+#endif
+
+constexpr Accuracy DEFAULT_ACCURACY = static_cast<Accuracy>(FASTMATH_ACCURACY);
+
+// 在 [-0.5, 0.5] 上逼近 2^f 的多项式系数 (按 Chebyshev 节点做相对误差最小二乘)
+constexpr float EXP2_P5[6] = {1.00000007f, 0.693146949f, 0.240221218f, 0.0555074262f, 0.00967545975f, 0.00132669704f};
+constexpr float EXP2_P3[4] = {0.99992894f, 0.693276242f, 0.242604051f, 0.0550886838f};
+
+// sqrt(1/2) 的位模式
+constexpr uint32_t SQRT_HALF_BITS = 0x3f3504f3;
+
+// 加上 1.5 * 2^23 后, float 的低位尾数就是四舍五入后的整数
+constexpr float ROUND_MAGIC = 12582912.f;
+// 在 [sqrt(1/2) - 1, sqrt(2) - 1) 上逼近 log2(1 + t) / t 的多项式系数,
+// 尾数取在 1 附近的区间, 结果接近 0 时也能保持相对精度
+constexpr float LOG2_Q5[6] = {1.44270024f, -0.721194012f, 0.479944839f, -0.366997805f, 0.316677845f, -0.201635815f};
+constexpr float LOG2_Q3[4] = {1.44231675f, -0.724799478f, 0.509900024f, -0.321330248f};
+
+template <int N>
+inline float horner(const float (&c)[N], float x)
+{
+    float r = c[N - 1];
+    for (int i = N - 2; i >= 0; i --)
+        r = r * x + c[i];
+    return r;
+}
+
+inline uint32_t bits(float x)
+{
+    uint32_t u;
+    std::memcpy(&u, &x, sizeof(u));
+    return u;
+}
+
+inline float from_bits(uint32_t u)
+{
+    float x;
+    std::memcpy(&x, &u, sizeof(x));
+    return x;
+}
+
+
+// --------------- scalar --------------- //
+
+inline float clamp(float x, float lo, float hi)
+{
+    return x < lo ? lo : (x > hi ? hi : x);
+}
+
+template <Accuracy A = DEFAULT_ACCURACY>
+inline float exp2(float x)
+{
+    if constexpr (A == Accuracy::EXACT)
+        return std::exp2(x);
+    x = clamp(x, -126.f, 127.f);
+    // 拆成整数 n 和 [-0.5, 0.5] 内的小数 f, 不经过 float/int 转换指令
+    float k = x + ROUND_MAGIC;
+    float f = x - (k - ROUND_MAGIC);
+    float scale = from_bits((bits(k) + 127) << 23);
+    if constexpr (A == Accuracy::FAST)
+        return scale * horner(EXP2_P5, f);
+    else
+        return scale * horner(EXP2_P3, f);
+}
+
+// x 必须为正的规格化数
+template <Accuracy A = DEFAULT_ACCURACY>
+inline float log2(float x)
+{
+    if constexpr (A == Accuracy::EXACT)
+        return std::log2(x);
+    // 以 sqrt(1/2) 的位模式为基准拆分指数和尾数, 尾数落在 [sqrt(1/2), sqrt(2)), 无分支
+    uint32_t u = bits(x) - SQRT_HALF_BITS;
+    float e = float(int32_t(u) >> 23);
+    float t = from_bits((u & 0x007fffff) + SQRT_HALF_BITS) - 1.f;
+    if constexpr (A == Accuracy::FAST)
+        return e + t * horner(LOG2_Q5, t);
+    else
+        return e + t * horner(LOG2_Q3, t);
+}
+
+// x <= 0 时按 y == 0 返回 1, 否则返回 0, 与着色器里 pow(max(x, 0), y) 的用法一致
+template <Accuracy A = DEFAULT_ACCURACY>
+inline float pow(float x, float y)
+{
+    if constexpr (A == Accuracy::EXACT)
+        return std::pow(x, y);
+    if (y == 0.f)
+        return 1.f;
+    if (x <= 0.f)
+        return 0.f;
+    return exp2<A>(y * log2<A>(x));
+}
+
+template <Accuracy A = DEFAULT_ACCURACY>
+inline float rsqrt(float x)
+{
+    if constexpr (A == Accuracy::EXACT)
+        return 1.f / std::sqrt(x);
+#if defined(__SSE2__)
+    if constexpr (A == Accuracy::FAST)
+    {
+        // 硬件近似 (12位) + 一次牛顿迭代
+        float r = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+        return r * (1.5f - 0.5f * x * r * r);
+    }
+#endif
+    float r = from_bits(0x5f3759df - (bits(x) >> 1));
+    r = r * (1.5f - 0.5f * x * r * r);
+    if constexpr (A == Accuracy::FAST)
+        r = r * (1.5f - 0.5f * x * r * r);
+    return r;
+}
+
+template <Accuracy A = DEFAULT_ACCURACY>
+inline Vec3f normalize(Vec3f v)
+{
+    float len2 = v * v;
+    if (len2 <= 0.f)
+        return v;
+    return v * rsqrt<A>(len2);
+}
+
+// --------------- SIMD (4 lanes) --------------- //
+
+#if defined(__SSE2__)
+
+template <int N>
+inline __m128 horner_ps(const float (&c)[N], __m128 x)
+{
+    __m128 r = _mm_set1_ps(c[N - 1]);
+    for (int i = N - 2; i >= 0; i --)
+        r = _mm_add_ps(_mm_mul_ps(r, x), _mm_set1_ps(c[i]));
+    return r;
+}
+
+template <Accuracy A = DEFAULT_ACCURACY>
+inline __m128 exp2_ps(__m128 x)
+{
+    if constexpr (A == Accuracy::EXACT)
+    {
+        alignas(16) float v[4];
+        _mm_store_ps(v, x);
+        for (float &e : v)
+            e = std::exp2(e);
+        return _mm_load_ps(v);
+    }
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-126.f)), _mm_set1_ps(127.f));
+    __m128 magic = _mm_set1_ps(ROUND_MAGIC);
+    __m128 k = _mm_add_ps(x, magic);
+    __m128 f = _mm_sub_ps(x, _mm_sub_ps(k, magic));
+    __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_castps_si128(k), _mm_set1_epi32(127)), 23));
+    if constexpr (A == Accuracy::FAST)
+        return _mm_mul_ps(scale, horner_ps(EXP2_P5, f));
+    else
+        return _mm_mul_ps(scale, horner_ps(EXP2_P3, f));
+}
+
+template <Accuracy A = DEFAULT_ACCURACY>
+inline __m128 log2_ps(__m128 x)
+{
+    if constexpr (A == Accuracy::EXACT)
+    {
+        alignas(16) float v[4];
+        _mm_store_ps(v, x);
+        for (float &e : v)
+            e = std::log2(e);
+        return _mm_load_ps(v);
+    }
+    __m128i base = _mm_set1_epi32(int(SQRT_HALF_BITS));
+    __m128i u = _mm_sub_epi32(_mm_castps_si128(x), base);
+    __m128 e = _mm_cvtepi32_ps(_mm_srai_epi32(u, 23));
+    __m128 m = _mm_castsi128_ps(_mm_add_epi32(_mm_and_si128(u, _mm_set1_epi32(0x007fffff)), base));
+    __m128 t = _mm_sub_ps(m, _mm_set1_ps(1.f));
+    if constexpr (A == Accuracy::FAST)
+        return _mm_add_ps(e, _mm_mul_ps(t, horner_ps(LOG2_Q5, t)));
+    else
+        return _mm_add_ps(e, _mm_mul_ps(t, horner_ps(LOG2_Q3, t)));
+}
+
+template <Accuracy A = DEFAULT_ACCURACY>
+inline __m128 pow_ps(__m128 x, __m128 y)
+{
+    __m128 zero = _mm_setzero_ps();
+    __m128 safe = _mm_max_ps(x, _mm_set1_ps(1e-30f));
+    __m128 r = exp2_ps<A>(_mm_mul_ps(y, log2_ps<A>(safe)));
+    // x <= 0 时为 0, y == 0 时为 1
+    r = _mm_and_ps(_mm_cmpgt_ps(x, zero), r);
+    __m128 yzero = _mm_cmpeq_ps(y, zero);
+    return _mm_or_ps(_mm_andnot_ps(yzero, r), _mm_and_ps(yzero, _mm_set1_ps(1.f)));
+}
+
+template <Accuracy A = DEFAULT_ACCURACY>
+inline __m128 rsqrt_ps(__m128 x)
+{
+    if constexpr (A == Accuracy::EXACT)
+        return _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(x));
+    __m128 r = _mm_rsqrt_ps(x);
+    if constexpr (A == Accuracy::FAST)
+    {
+        __m128 half_x = _mm_mul_ps(_mm_set1_ps(.5f), x);
+        r = _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(half_x, _mm_mul_ps(r, r))));
+    }
+    return r;
+}
+
+inline __m128 clamp_ps(__m128 x, __m128 lo, __m128 hi)
+{
+    return _mm_min_ps(_mm_max_ps(x, lo), hi);
+}
+
+#endif
+
+} // namespace fastmath
@@ -0,0 +1,116 @@
+#pragma once
+#include <vector>
+#include "image.h"
+#include "memstats.h"
+
+namespace mygl
+{
+
+// 渲染目标: 颜色 (RGB8) 和深度 (Gray8).
+// TILED 布局下按 TILE x TILE 的光栅化分块存放, 一个分块的像素在内存中连续,
+// 只在输出时 resolve 成行线性的图像; LINEAR 布局与 TGAImage 相同.
+//
+// samples 为 4 时是 4x MSAA: 每个像素 4 个采样点各有覆盖和深度, 片段着色每像素只做一次.
+// 颜色按像素压缩存放: 采样点 0 的颜色在颜色缓冲中, 采样点 1-3 的颜色在另外三个平面中,
+// 另有每像素一个标记, 像素的 4 个采样点被同一个片段覆盖时置位, 此时只有颜色缓冲中的值有效,
+// 写入和 resolve 都不碰其余三个平面. 三角形内部的像素都是这种情况, 只有边缘像素存放各采样点的颜色.
+class Framebuffer
+{
+public:
+    enum Layout
+    {
+        LINEAR,
+        TILED
+    };
+
+    static constexpr int TILE = 16;
+    // 每像素采样点数的上限
+    static constexpr int MAX_SAMPLES = 4;
+
+    Framebuffer();
+    // samples 为 1 或 4
+    Framebuffer(int w, int h, Layout layout = TILED, int samples = 1);
+
+    // 同样参数构造的帧缓冲占用的字节数 (颜色, 深度, 整像素标记和着色率), 与 memstats 中计入的相同
+    static size_t bytes(int w, int h, Layout layout = TILED, int samples = 1);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    Layout layout() const { return layout_; }
+    int samples() const { return samples_; }
+
+    size_t index(int x, int y) const
+    {
+        if (layout_ == TILED)
+            return tiled_index<TILE>(x, y, tiles_x_);
+        return size_t(x) + size_t(y) * width_;
+    }
+
+    // 不做边界检查. 多重采样时 color 为采样点 0 的颜色, depth 为连续存放的 samples() 个采样点的深度
+    unsigned char *color(int x, int y) { return color_.buffer() + index(x, y) * RGB8::bytespp; }
+    unsigned char *depth(int x, int y) { return depth_.buffer() + index(x, y) * samples_; }
+
+    // 多重采样时把颜色写入 mask 中的采样点 (第 i 位对应采样点 i), 维护整像素标记
+    void store(int x, int y, unsigned mask, TGAColor c)
+    {
+        size_t i = index(x, y);
+        unsigned char *flag = full_.buffer() + i;
+        if (mask == (1u << samples_) - 1)
+        {
+            *flag = 1;
+            Image<RGB8>::encode(color_.buffer() + i * RGB8::bytespp, c);
+            return;
+        }
+        // 部分覆盖一个整像素时先把它的颜色展开到各个采样点
+        if (*flag)
+        {
+            *flag = 0;
+            for (int s = 1; s < samples_; s ++)
+                memcpy(extra_[s - 1].buffer() + i * RGB8::bytespp, color_.buffer() + i * RGB8::bytespp, RGB8::bytespp);
+        }
+        if (mask & 1)
+            Image<RGB8>::encode(color_.buffer() + i * RGB8::bytespp, c);
+        for (int s = 1; s < samples_; s ++)
+            if (mask & (1u << s))
+                Image<RGB8>::encode(extra_[s - 1].buffer() + i * RGB8::bytespp, c);
+    }
+
+    void clear();
+    // 只清空一个分块 (tx, ty 为分块坐标), 其余像素保持不变
+    void clear_tile(int tx, int ty);
+
+    // 可变着色率: 每个分块一个着色率 rate (1, 2 或 4), 分块内每 rate x rate 个像素只做一次片段着色.
+    // 默认全为 1, clear 不改变着色率
+    int shading_rate(int x, int y) const { return rates_[size_t(y / TILE) * tiles_x_ + x / TILE]; }
+    void set_shading_rate(int tx, int ty, int rate) { rates_[size_t(ty) * tiles_x_ + tx] = (unsigned char)rate; }
+    void set_shading_rates(int rate);
+    int tiles_x() const { return tiles_x_; }
+    int tiles_y() const { return (height_ + TILE - 1) / TILE; }
+
+    // 按上一帧的图像 (行线性布局, 尺寸与帧缓冲相同) 自适应地选择各分块的着色率:
+    // 分块内相邻像素亮度差的平均值低于 threshold 时取 2, 低于 threshold / 4 时取 4, 其余取 1
+    void adapt_shading_rates(const Image<RGB8> &previous, float threshold);
+
+    // 转换成行线性布局, 输出图像尺寸必须与帧缓冲一致.
+    // 多重采样时颜色取各采样点的平均, 深度取各采样点中最近的 (值最大的)
+    void resolve(Image<RGB8> &color, Image<Gray8> &depth) const;
+
+private:
+    void resolveSamples(Image<RGB8> &color, Image<Gray8> &depth) const;
+
+    // 补齐到整块后的存储, 只当作字节缓冲使用
+    Image<RGB8> color_;
+    Image<Gray8> depth_;            // 每像素 samples_ 个字节
+    std::vector<Image<RGB8>> extra_; // 采样点 1 到 samples_ - 1 的颜色平面, 布局与 color_ 相同
+    Image<Gray8> full_;             // 整像素标记, 布局与 color_ 相同
+    std::vector<unsigned char> rates_; // 每个分块的着色率
+    memstats::Tracker color_memory_ = memstats::Tracker(memstats::FRAMEBUFFER);
+    memstats::Tracker depth_memory_ = memstats::Tracker(memstats::DEPTH);
+    int width_;
+    int height_;
+    int tiles_x_;
+    Layout layout_;
+    int samples_;
+};
+
+} // namespace mygl
@@ -0,0 +1,226 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// 打包的4字节颜色, 字节顺序与TGA文件一致(BGRA)
+struct TGAColor
+{
+	union
+	{
+		struct
+		{
+			unsigned char b, g, r, a;
+		};
+		unsigned char raw[4];
+		unsigned int val;
+	};
+
+	TGAColor() : val(0)
+	{
+	}
+
+	TGAColor(unsigned char v) : raw()
+	{
+		for (int i = 0; i < 4; i ++)
+			raw[i] = v;
+	}
+
+	TGAColor(unsigned char R, unsigned char G, unsigned char B) : b(B), g(G), r(R), a(0)
+	{
+	}
+
+	TGAColor(unsigned char R, unsigned char G, unsigned char B, unsigned char A) : b(B), g(G), r(R), a(A)
+	{
+	}
+
+	// bpp 只用于兼容旧接口, 颜色本身总是4字节
+	TGAColor(int v, int) : val(v)
+	{
+	}
+
+	TGAColor(const unsigned char *p, int bpp) : val(0)
+	{
+		for (int i = 0; i < bpp; i++)
+		{
+			raw[i] = p[i];
+		}
+	}
+
+	TGAColor operator *(float intensity) const {
+		TGAColor res = *this;
+		intensity = (intensity > 1.f ? 1.f : (intensity < 0.f ? 0.f : intensity));
+		res.b = static_cast<unsigned char>(b * intensity);
+		res.r = static_cast<unsigned char>(r * intensity);
+		res.g = static_cast<unsigned char>(g * intensity);
+		res.a = static_cast<unsigned char>(a * intensity);
+		return res;
+	}
+
+	unsigned char& operator[] (const int idx)
+	{
+		assert(idx >= 0 && idx < 4);
+		return raw[idx];
+	}
+
+	const unsigned char& operator[] (const int idx) const
+	{
+		assert(idx >= 0 && idx < 4);
+		return raw[idx];
+	}
+};
+
+static_assert(sizeof(TGAColor) == 4, "TGAColor must stay packed into 4 bytes");
+
+
+// --------------- pixel formats --------------- //
+
+struct Gray8
+{
+	using value_type = unsigned char;
+	static constexpr int bytespp = 1;
+};
+
+struct RGB8
+{
+	using value_type = unsigned char;
+	static constexpr int bytespp = 3;
+};
+
+struct RGBA8
+{
+	using value_type = unsigned char;
+	static constexpr int bytespp = 4;
+};
+
+struct R32F
+{
+	using value_type = float;
+	static constexpr int bytespp = 4;
+};
+
+
+// --------------- memory layouts --------------- //
+
+// 把16位整数的各位间隔插入0, 用于计算Morton序
+inline uint32_t morton_spread(uint32_t v)
+{
+	v &= 0x0000ffff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+// Morton(Z序)下标: x 占偶数位, y 占奇数位
+inline size_t morton_index(int x, int y)
+{
+	return morton_spread(uint32_t(x)) | (morton_spread(uint32_t(y)) << 1);
+}
+
+// N x N 分块存储的下标: 块按行排列, 块内像素按行排列, tiles_x 为每行的块数
+template <int N>
+inline size_t tiled_index(int x, int y, int tiles_x)
+{
+	return (size_t(y / N) * tiles_x + x / N) * (N * N) + (y % N) * N + (x % N);
+}
+
+
+// --------------- image storage --------------- //
+
+// 按像素格式模板化的图像存储, 每像素字节数在编译期确定.
+// get/set/pixel 不做边界检查, 供光栅化等调用方已保证坐标合法的热路径使用;
+// 其余场景使用 get_checked/set_checked.
+template <class Format>
+class Image
+{
+public:
+	using format = Format;
+	static constexpr int bytespp = Format::bytespp;
+
+	Image() : width_(0), height_(0) {}
+
+	Image(int w, int h) : width_(w), height_(h), data_(size_t(w) * h * bytespp) {}
+
+	int width() const { return width_; }
+	int height() const { return height_; }
+	bool empty() const { return data_.empty(); }
+	size_t bytes() const { return data_.size(); }
+
+	unsigned char *buffer() { return data_.data(); }
+	const unsigned char *buffer() const { return data_.data(); }
+
+	bool in_bounds(int x, int y) const
+	{
+		return x >= 0 && y >= 0 && x < width_ && y < height_;
+	}
+
+	unsigned char *pixel(int x, int y)
+	{
+		assert(in_bounds(x, y));
+		return data_.data() + (size_t(x) + size_t(y) * width_) * bytespp;
+	}
+
+	const unsigned char *pixel(int x, int y) const
+	{
+		assert(in_bounds(x, y));
+		return data_.data() + (size_t(x) + size_t(y) * width_) * bytespp;
+	}
+
+	static TGAColor decode(const unsigned char *p)
+	{
+		TGAColor c;
+		std::memcpy(c.raw, p, bytespp);
+		return c;
+	}
+
+	static void encode(unsigned char *p, TGAColor c)
+	{
+		std::memcpy(p, c.raw, bytespp);
+	}
+
+	TGAColor get(int x, int y) const { return decode(pixel(x, y)); }
+	void set(int x, int y, TGAColor c) { encode(pixel(x, y), c); }
+
+	// 单通道浮点格式 (R32F) 的访问
+	float getf(int x, int y) const
+	{
+		static_assert(sizeof(typename Format::value_type) == sizeof(float), "float access needs a 32-bit format");
+		float v;
+		std::memcpy(&v, pixel(x, y), sizeof(float));
+		return v;
+	}
+
+	void setf(int x, int y, float v)
+	{
+		static_assert(sizeof(typename Format::value_type) == sizeof(float), "float access needs a 32-bit format");
+		std::memcpy(pixel(x, y), &v, sizeof(float));
+	}
+
+	TGAColor get_checked(int x, int y) const
+	{
+		if (!in_bounds(x, y) || empty())
+			return TGAColor();
+		return get(x, y);
+	}
+
+	bool set_checked(int x, int y, TGAColor c)
+	{
+		if (!in_bounds(x, y) || empty())
+			return false;
+		set(x, y, c);
+		return true;
+	}
+
+	void clear()
+	{
+		std::memset(data_.data(), 0, data_.size());
+	}
+
+private:
+	int width_;
+	int height_;
+	std::vector<unsigned char> data_;
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <type_traits>
+#include "image.h"
+
+// 图像批量操作: 填充, 矩形拷贝, 水平翻转, 重采样.
+// 底层 kernel 按字节处理整行数据, 有 SSE2 时走向量化路径.
+namespace imageops
+{
+
+void fill_bytes(unsigned char *data, int w, int h, int bpp, TGAColor c);
+
+void flip_bytes_horizontally(unsigned char *data, int w, int h, int bpp);
+
+void blit_bytes(unsigned char *dst, int dst_w, int dst_h,
+                const unsigned char *src, int src_w, int src_h,
+                int bpp, int dx, int dy, int sx, int sy, int w, int h);
+
+// 整数倍box下采样, dst 大小为 (sw / factor) x (sh / factor)
+void downsample_box_bytes(const unsigned char *src, int sw, int sh,
+                          unsigned char *dst, int factor, int bpp);
+
+// 双线性重采样, 放大和缩小都可用
+void resample_bilinear_bytes(const unsigned char *src, int sw, int sh,
+                             unsigned char *dst, int dw, int dh, int bpp);
+
+
+template <class Format>
+void fill(Image<Format> &img, TGAColor c)
+{
+    fill_bytes(img.buffer(), img.width(), img.height(), Format::bytespp, c);
+}
+
+template <class Format>
+void flip_horizontally(Image<Format> &img)
+{
+    flip_bytes_horizontally(img.buffer(), img.width(), img.height(), Format::bytespp);
+}
+
+// 将 src 中以 (sx, sy) 为左上角, 大小 w x h 的矩形拷贝到 dst 的 (dx, dy), 超出部分裁掉
+template <class Format>
+void blit(Image<Format> &dst, int dx, int dy, const Image<Format> &src, int sx, int sy, int w, int h)
+{
+    blit_bytes(dst.buffer(), dst.width(), dst.height(), src.buffer(), src.width(), src.height(),
+               Format::bytespp, dx, dy, sx, sy, w, h);
+}
+
+// 将 src 重采样到 dst 的尺寸: 整数倍缩小时用box滤波, 其余情况用双线性
+template <class Format>
+void resample(const Image<Format> &src, Image<Format> &dst)
+{
+    static_assert(std::is_same<typename Format::value_type, unsigned char>::value,
+                  "resampling works on 8-bit channels");
+    if (src.empty() || dst.empty())
+        return;
+    int fx = src.width() / dst.width();
+    int fy = src.height() / dst.height();
+    if (fx == fy && fx >= 1 && src.width() == dst.width() * fx && src.height() == dst.height() * fy)
+        downsample_box_bytes(src.buffer(), src.width(), src.height(), dst.buffer(), fx, Format::bytespp);
+    else
+        resample_bilinear_bytes(src.buffer(), src.width(), src.height(),
+                                dst.buffer(), dst.width(), dst.height(), Format::bytespp);
+}
+
+} // namespace imageops
@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+
+// 渲染服务用的最小 JSON 实现: 支持全部值类型, 数字一律存为 double,
+// 字符串支持标准转义, \uXXXX (含代理对) 转成 UTF-8.
+namespace json
+{
+
+struct Value
+{
+    enum Type
+    {
+        NUL,
+        BOOL,
+        NUMBER,
+        STRING,
+        ARRAY,
+        OBJECT
+    };
+
+    Type type = NUL;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<Value> array;
+    std::vector<std::pair<std::string, Value>> object;  // 保持原来的顺序, 重复的键取第一个
+
+    // 对象的成员, 不存在或者自己不是对象时返回 nullptr
+    const Value *get(const std::string &key) const;
+};
+
+// 整个文本必须是一个值 (前后可以有空白), 出错时返回 false, error 为错误描述和位置
+bool parse(const std::string &text, Value &value, std::string *error = nullptr);
+
+// 序列化成紧凑的一行
+std::string dump(const Value &value);
+
+// 转义并加上引号
+std::string quote(const std::string &s);
+
+} // namespace json
@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <iosfwd>
+
+// 按用途分类的内存统计: 各类当前和峰值的字节数.
+// 占用大块内存的对象 (网格, 贴图, 帧缓冲, 帧临时数据, TGA 读写用的图像) 各带一个 Tracker,
+// 分配或者释放存储后把自己的字节数告诉 Tracker, 小对象和标准库内部的分配不计入.
+// 进程退出时 (见 main) 把汇总写到标准错误.
+namespace memstats
+{
+
+enum Category
+{
+    MESH,           // 顶点缓冲和各级 LOD 的索引
+    DIFFUSE_MAP,
+    SPECULAR_MAP,
+    NORMAL_MAP,     // 法线贴图, 包括解码和变换后的 float3 法线
+    MATERIAL_MAP,   // 交错的材质贴图
+    TEXTURE,        // 不属于以上用途的贴图
+    FRAMEBUFFER,    // 帧缓冲的颜色, 多重采样平面和着色率, 以及动态分辨率的中间图像
+    DEPTH,
+    TRANSIENT,      // 流水线的帧临时数据和线程临时分配 (mygl::Arena)
+    IO,             // TGA 读写用的图像, 流式读取网格的缓冲
+    CATEGORIES
+};
+
+const char *name(Category category);
+
+struct Usage
+{
+    size_t current = 0;
+    size_t peak = 0;
+};
+
+Usage usage(Category category);
+// 所有类别之和, 峰值为总和的峰值 (不是各类峰值之和)
+Usage total();
+
+// 每类一行: 当前和峰值, 单位 KB
+void print(std::ostream &out);
+
+
+// 一个任务 (渲染服务的一个请求, 一次批量渲染) 的内存: 用 JobScope 关联到任务的线程上,
+// 这些线程上的 Tracker 增减都计入, 其他线程 (比如资源加载线程) 上的不计入.
+// 用量超过 limit 时 exceeded() 为真, 由任务自己决定在什么时候检查并放弃. limit 为 0 时不限制
+class Job
+{
+public:
+    explicit Job(size_t limit = 0) : limit_(limit), current_(0), peak_(0) {}
+
+    Job(const Job &) = delete;
+    Job &operator=(const Job &) = delete;
+
+    size_t limit() const { return limit_; }
+    size_t current() const;
+    size_t peak() const;
+    // 当前用量超过上限
+    bool exceeded() const { return limit_ > 0 && current() > limit_; }
+
+    void add(long long delta);
+
+private:
+    size_t limit_;
+    std::atomic<long long> current_;
+    std::atomic<long long> peak_;
+};
+
+// 作用域内当前线程的统计同时计入 job, 可以嵌套
+class JobScope
+{
+public:
+    explicit JobScope(Job &job);
+    ~JobScope();
+
+    JobScope(const JobScope &) = delete;
+    JobScope &operator=(const JobScope &) = delete;
+
+private:
+    Job *previous_;
+};
+
+
+// 一个对象占用的某类内存. 复制时按复制出的存储计一份, 移动时转移
+class Tracker
+{
+public:
+    explicit Tracker(Category category) : category_(category), bytes_(0) {}
+    Tracker(const Tracker &other) : category_(other.category_), bytes_(0) { set(other.bytes_); }
+    Tracker(Tracker &&other) noexcept : category_(other.category_), bytes_(other.bytes_) { other.bytes_ = 0; }
+    ~Tracker() { set(0); }
+
+    Tracker &operator=(const Tracker &other);
+    Tracker &operator=(Tracker &&other) noexcept;
+
+    // 存储大小变为 bytes
+    void set(size_t bytes);
+    void set(Category category, size_t bytes);
+
+    Category category() const { return category_; }
+    size_t bytes() const { return bytes_; }
+
+private:
+    Category category_;
+    size_t bytes_;
+};
+
+} // namespace memstats
@@ -0,0 +1,52 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "geometry.h"
+#include "memstats.h"
+
+// 索引缓冲引用的顶点, 位置/法线/纹理坐标的组合在加载时去重
+struct Vertex
+{
+    Vec3f pos;
+    Vec3f normal;
+    Vec2f uv;
+};
+
+// 一级 LOD: 引用模型共享顶点缓冲的索引, 每三个索引为一个三角形
+struct Mesh
+{
+    std::vector<int> indices;
+    float error = 0.f;      // 相对原始网格的最大几何误差, 与顶点坐标同单位
+
+    int nfaces() const { return int(indices.size() / 3); }
+};
+
+// OBJ 中 v / vt / vn 的个数, 只用于日志
+struct SourceCounts
+{
+    int nverts = 0;
+    int ntextures = 0;
+    int nnormals = 0;
+};
+
+// 从 OBJ 加载的网格资源: 去重后的顶点缓冲和各级 LOD, 加载完成后只读, 可以被多个模型共享
+struct MeshAsset
+{
+    static constexpr int MIN_LOD_FACES = 16;
+
+    std::vector<Vertex> vertices;
+    std::vector<Mesh> lods;         // 0 级为原始网格, 之后每级三角形数约为上一级的 1/4
+    SourceCounts counts;
+    Vec3f center;                   // 包围球
+    float radius = 0.f;
+    memstats::Tracker memory = memstats::Tracker(memstats::MESH);   // 顶点和索引缓冲
+
+    // optimize 为 true 时加载后重排三角形和顶点的顺序, 生成 LOD, 并把结果存入网格缓存, 见 meshopt.h.
+    // 文件无法读取时返回 nullptr
+    static std::shared_ptr<MeshAsset> load(const char *filename, bool optimize = true);
+
+private:
+    bool load_obj(const char *filename);
+    void optimize();
+    void build_lods();
+};
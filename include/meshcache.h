@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mesh.h"
+
+// 网格缓存: 把加载时优化好的顶点缓冲和各级 LOD 存成二进制文件, 下次加载直接读取,
+// 不再解析 OBJ, 也不再重复做顶点缓存优化和简化.
+// 文件按本机字节序存放, 只作为本机的缓存, 源文件的大小或修改时间变化后自动失效.
+namespace meshcache
+{
+
+// 源文件的大小和修改时间合成的标记, 文件不存在时返回0
+uint64_t source_stamp(const char *filename);
+
+// 缓存不存在, 已失效或者损坏时返回 false, 输出参数不变
+bool load(const std::string &path, uint64_t stamp, std::vector<Vertex> &vertices, std::vector<Mesh> &lods,
+          SourceCounts &counts);
+
+// 不读入缓存, 只校验文件头并返回顶点缓冲和 0 级 LOD 索引在文件中的位置, 供流式读取
+struct Layout
+{
+    uint32_t nvertices;
+    uint64_t vertex_offset;
+    uint32_t nindices;
+    uint64_t index_offset;
+};
+bool locate(const std::string &path, uint64_t stamp, Layout &layout);
+
+bool save(const std::string &path, uint64_t stamp, const std::vector<Vertex> &vertices, const std::vector<Mesh> &lods,
+          const SourceCounts &counts);
+
+} // namespace meshcache
@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include "geometry.h"
+
+// 加载时的网格优化, 只改变三角形和顶点的顺序, 不改变网格本身.
+// 依次做: 顶点缓存优化 (Forsyth), 按簇的 overdraw 排序, 按首次使用重排顶点.
+namespace meshopt
+{
+
+// 变换后顶点缓存的模拟大小 (FIFO)
+constexpr int FIFO_SIZE = 16;
+
+// 平均每个三角形的缓存未命中次数 (ACMR), 越接近 0.5 越好, 最差为 3
+float acmr(const std::vector<int> &indices, int nverts, int cache_size = FIFO_SIZE);
+
+// Forsyth 的线性时间顶点缓存优化, 返回新的索引
+std::vector<int> optimize_vertex_cache(const std::vector<int> &indices, int nverts);
+
+// 把缓存优化后的顺序切分成小簇, 按簇朝外的程度从大到小排序, 先画外侧的簇,
+// 被遮挡的片段更早被深度测试剔除. 簇内顺序不变, ACMR 最多变差 5%.
+std::vector<int> optimize_overdraw(const std::vector<int> &indices, const std::vector<Vec3f> &positions);
+
+// 按顶点在索引中首次出现的顺序重新编号, 返回 remap[旧顶点] = 新顶点, 并改写索引.
+// 从未使用的顶点映射为 -1.
+std::vector<int> optimize_vertex_fetch(std::vector<int> &indices, int nverts);
+
+// 二次误差度量的边折叠简化, 顶点只会折叠到相邻顶点上, 不产生新顶点, 可以共享原顶点缓冲.
+// 纹理接缝两侧的顶点只能沿接缝成对折叠, 开放边界上的顶点只能沿边界折叠, 接缝和边界的形状保持不变.
+// 三角形数降到 target_faces 或者下一次折叠的误差超过 max_error 时停止, 实际误差写入 result_error.
+std::vector<int> simplify(const std::vector<int> &indices, const std::vector<Vec3f> &positions,
+                          int target_faces, float max_error, float *result_error = nullptr);
+
+} // namespace meshopt
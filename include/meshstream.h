@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "mesh.h"
+#include "memstats.h"
+
+// 一批流式读取的三角形, 每三个顶点为一个三角形, 不共享顶点
+struct MeshChunk
+{
+    std::vector<Vertex> vertices;
+
+    int nfaces() const { return int(vertices.size() / 3); }
+};
+
+// 按批读取网格, 整个网格不进入内存, 用于超出内存预算的大网格.
+// 网格缓存有效时按缓存里优化过的顺序读取 0 级 LOD, 顶点通过按页缓存的随机读取取得;
+// 否则分两遍读 OBJ: 第一遍把 v / vt / vn 写到临时文件, 第二遍按文件顺序读面, 属性同样按页读取.
+// 两种来源得到的三角形和顶点与 MeshAsset::load(filename, true / false) 完全相同, 绘制结果也相同.
+// 读取缓冲, 页缓存和一批三角形占用的内存合计不超过 memory_cap.
+class MeshStream
+{
+public:
+    static constexpr size_t MIN_MEMORY_CAP = 64 * 1024;
+
+    MeshStream(const char *filename, size_t memory_cap);
+    ~MeshStream();
+    MeshStream(const MeshStream &) = delete;
+    MeshStream &operator=(const MeshStream &) = delete;
+
+    // 文件无法读取, 缓存损坏或者 OBJ 的索引越界时为 false
+    bool ok() const { return !failed_; }
+    bool cached() const { return cached_; }
+    // 读取下一批到 chunk, 没有更多三角形 (或出错) 时返回 false
+    bool next(MeshChunk &chunk);
+    // 每批最多的三角形数
+    int chunk_faces() const { return chunk_faces_; }
+    // 已读出的三角形数
+    long faces() const { return faces_; }
+    // 已分配的缓冲和读取缓冲的峰值
+    size_t peak_bytes() const { return peak_; }
+
+private:
+    // 定长记录的文件, 按页读取, 最近最少使用的页被替换
+    class Pages
+    {
+    public:
+        void open(std::istream *in, uint64_t offset, uint64_t nrecords, size_t record, size_t budget);
+        // 第 i 条记录, 越界或读取失败时返回 nullptr
+        const char *get(uint64_t i);
+        size_t bytes() const;
+
+    private:
+        struct Page
+        {
+            uint64_t id = UINT64_MAX;
+            uint64_t used = 0;
+            std::vector<char> data;
+        };
+        std::istream *in_ = nullptr;
+        uint64_t offset_ = 0;
+        uint64_t nrecords_ = 0;
+        size_t record_ = 0;
+        size_t page_records_ = 0;
+        uint64_t clock_ = 0;
+        std::vector<Page> pages_;
+    };
+
+    bool open_cache(const char *filename, size_t budget);
+    bool open_obj(const char *filename, size_t budget);
+    bool next_cached(MeshChunk &chunk);
+    bool next_obj(MeshChunk &chunk);
+    void track(const MeshChunk &chunk);
+
+    bool failed_;
+    bool cached_;
+    int chunk_faces_;
+    long faces_;
+    size_t peak_;
+    memstats::Tracker memory_ = memstats::Tracker(memstats::IO);
+    std::vector<char> ioBuffer_;
+    std::string line_;
+
+    // 缓存: 顶点缓冲和 0 级 LOD 的索引
+    std::ifstream cache_;
+    Pages vertices_;
+    Pages indices_;
+    uint64_t nindices_;
+    uint64_t cursor_;
+
+    // OBJ: 源文件和 v / vt / vn 的临时文件
+    std::ifstream obj_;
+    std::string spill_[3];
+    std::fstream spillFiles_[3];
+    Pages attrs_[3];
+};
@@ -3,6 +3,9 @@
 #include <vector>
 #include "geometry.h"
 #include "tgaimage.h"
+#include "texture.h"
+#include "mesh.h"
+#include "assets.h"
 
 
 template <class t>
@@ -31,27 +34,59 @@ private:
 class Model
 {
 public:
-	Model(const char *filename);
+	static constexpr float LOD_PIXEL_ERROR = 1.f;
+
+	// compress 为 true 时贴图以块压缩的形式常驻内存: 漫反射 BC1, 镜面反射 BC4, 法线 BC5
+	// optimize 见 MeshAsset::load. 贴图路径由 resolve_material 决定.
+	// 网格和贴图通过 assets 加载并与其他模型共享, 为空时使用 AssetManager::shared()
+	// geometry 为 false 时只加载贴图, 网格由调用者用 MeshStream 分批读取
+	Model(const char *filename, Texture::Layout layout = Texture::LINEAR, bool compress = false, bool optimize = true,
+	      AssetManager *assets = nullptr, bool geometry = true);
 	~Model();
 	int nverts();
 	int nfaces();
 	int ntextures();
 	int nnormals();
 	Trangle face(int idx);
+	// 最精细一级 LOD 的索引, 每三个索引为一个三角形
+	const std::vector<int> &indices() const { return lod(0).indices; }
+	const std::vector<Vertex> &vertices() const { return mesh_->vertices; }
+	// 0 级为原始网格, 之后每级三角形数约为上一级的 1/4, 各级共享 vertices(). 网格加载失败时 nlods() 为 0, lod() 为空网格
+	int nlods() const;
+	const Mesh &lod(int level) const;
+	// 模型每单位长度在屏幕上约占 pixels_per_unit 个像素时, 屏幕误差不超过 LOD_PIXEL_ERROR 的最粗一级
+	int select_lod(float pixels_per_unit) const;
+	// 包围球
+	Vec3f center() const { return mesh_->center; }
+	float radius() const { return mesh_->radius; }
 	Vec3f vert(int iface, int ivert);
 	Vec3f normal(int iface, int ivert);
 	Vec3f normal(Vec2f& uvf);
+	// 预先用 mit 变换好整张法线贴图, mit 与上次相同时直接复用. 压缩模式下只记下 mit
+	void prepare_view_normals(const Matrix4f &mit);
+	// 已变换并归一化的法线, 需要先调用 prepare_view_normals. 压缩模式下从 BC5 贴图解码后变换
+	Vec3f view_normal(Vec2f uvf);
+	// 打开后, 未压缩并且三张贴图分辨率相同时, prepare_view_normals 同时生成交错的材质贴图 (16 字节/纹素).
+	// 默认关闭; 压缩模式下总是不生成, 着色器直接从块压缩贴图采样
+	void set_material(bool enable);
+	bool has_material();
+	// 一次读取得到变换后的法线, 漫反射颜色和镜面反射指数
+	const MaterialTexel &material(Vec2f uvf);
 	Vec2f texture(int iface, int ivert);
-	void load_texture(std::string filename, TGAImage& img);
 	TGAColor getTexture(Vec2f uv);
 	float specular(Vec2f uvf);
 
 private:
-	std::vector<Vec3f> verts_;
-	std::vector<Vec3f> normals_;
-	std::vector<Vec2f> textures_;
-	std::vector<Trangle> faces_;
-	TGAImage textureMap;
-	TGAImage normalMap;
-	TGAImage specularMap;
+	std::shared_ptr<const MeshAsset> mesh_;
+	Texture::Layout layout_;
+	bool compress_;
+	bool useMaterial;
+	// 贴图和网格都是共享的只读资源, 下面的视图相关数据每个模型各有一份
+	std::shared_ptr<const Texture> textureMap;
+	std::shared_ptr<const Texture> normalMap;		// 压缩模式下为 BC5
+	std::shared_ptr<const Texture> specularMap;
+	NormalMap viewNormals;		// 经过 viewNormalsMatrix 变换的法线贴图, 压缩模式下为空
+	MaterialMap materialMap;	// 漫反射 + 镜面反射 + viewNormals 交错存放
+	Matrix4f viewNormalsMatrix;
+	bool hasViewNormals;
 };
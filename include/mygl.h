@@ -1,33 +1,92 @@
 #pragma once
 #include "tgaimage.h"
 #include "geometry.h"
+#include "framebuffer.h"
 
 namespace mygl
 {
-// 用extern防止多次定义
-extern Matrix4f modelView;
-extern Matrix4f viewport;
-extern Matrix4f projection;
+// 一个视图的相机状态. 没有全局的相机, 每个渲染任务各持有一份, 不同相机的视图可以同时渲染
+struct View
+{
+    Matrix4f modelView;
+    Matrix4f viewport;
+    Matrix4f projection;
+
+    // viewport * projection * modelView
+    Matrix4f transform() const { return viewport * projection * modelView; }
+};
+
+void viewportMatrix(View &view, int x, int y, int w, int h);
+
+void projectionMatrix(View &view, float coeff);
+
+void viewMatrix(View &view, Vec3f cameraPos, Vec3f lookPos, Vec3f upDir);
+
+
+// 每个顶点最多输出的 varying 数量
+constexpr int MAX_VARYINGS = 8;
+
+// 屏幕空间的平面方程 f(x, y) = dx * x + dy * y + c, 在三角形设置阶段求出
+struct Plane
+{
+    float dx, dy, c;
 
-void viewportMatrix(int x, int y, int w, int h);
+    float at(float x, float y) const { return dx * x + dy * y + c; }
+};
 
-void projectionMatrix(float coeff);
+// 片段着色器的输入, 由光栅化器做透视校正插值
+struct Fragment
+{
+    Vec3f bar;                      // 透视校正后的重心坐标
+    float varying[MAX_VARYINGS];    // 透视校正后的 varying
+    float w;                        // 片段的裁剪空间 w
 
-void viewMatrix(Vec3f cameraPos, Vec3f lookPos, Vec3f upDir);
+    // 第 i 个 varying 在屏幕空间的导数 (d/dx, d/dy), 可用于选择纹理 LOD
+    Vec2f derivative(int i) const
+    {
+        // varying = A / Q, A = varying / w 与 Q = 1 / w 都是屏幕空间的线性函数
+        return Vec2f((attr[i].dx - varying[i] * inv_w->dx) * w,
+                     (attr[i].dy - varying[i] * inv_w->dy) * w);
+    }
 
+    const Plane *attr;      // varying / w 的平面方程
+    const Plane *inv_w;     // 1 / w 的平面方程
+};
 
 class IShader
 {
 public:
     virtual ~IShader();
 
-    // 顶点着色器
+    // 顶点着色器, 需要插值的量写入 varying[nthvert][0, nvaryings)
     virtual Vec4f vertex(int iface, int nthvert) = 0;
 
-    // 片段着色器
-    virtual bool fragment(Vec3f bar, TGAColor &color) = 0;
+    // 片段着色器, 返回是否丢弃该像素
+    virtual bool fragment(const Fragment &frag, TGAColor &color) = 0;
+
+    int nvaryings = 0;
+    float varying[3][MAX_VARYINGS];
+
+    // 这次绘制的着色率 (1, 2 或 4): 每 rate x rate 个像素只调用一次 fragment, 与帧缓冲分块的着色率取较粗的
+    int shading_rate = 1;
+};
+
+// 两级光栅化的块大小, 整块在三角形内或外时不逐像素测试覆盖. 帧缓冲分块的边长是它的整数倍
+constexpr int RASTER_BLOCK = 8;
+
+// 4x MSAA 的采样点相对像素中心的偏移 (旋转网格), 像素中心在整数坐标上
+constexpr float MSAA_POSITIONS[Framebuffer::MAX_SAMPLES][2] = {
+    {-0.125f, -0.375f}, {0.375f, -0.125f}, {-0.375f, 0.125f}, {0.125f, 0.375f}};
+
+// 光栅化的裁剪矩形, 包含边界. 一帧分成几个互不重叠, 边界对齐到帧缓冲分块的矩形分别光栅化时, 结果与整帧一次光栅化相同
+struct Rect
+{
+    int x0, y0, x1, y1;
 };
 
-void triangle(Vec4f *pts, IShader &shader, TGAImage &image, TGAImage &zbuffer);
+// 帧缓冲的像素访问不做边界检查, 三角形包围盒会先裁剪到帧缓冲范围内 (以及 scissor 内).
+// 三角形设置时求出重心坐标, z/w, 1/w 和 varying/w 的平面方程, 逐像素只做增量加法和一次倒数.
+// 帧缓冲多重采样时覆盖和深度按采样点测试, 片段着色仍然每像素一次.
+void triangle(Vec4f *pts, IShader &shader, Framebuffer &fb, const Rect *scissor = nullptr);
 
 } // namespace mygl
@@ -0,0 +1,175 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "arena.h"
+#include "mygl.h"
+#include "render.h"
+#include "scene.h"
+#include "scheduler.h"
+
+// 多帧流水线: 每帧拆成三类任务交给 mygl::Scheduler
+//   几何 (剔除, 选择 LOD, 顶点着色, 按条分箱) -> 各条的光栅化和片段着色 -> 输出 (resolve, 翻转, 编码, 写文件)
+// 帧之间没有依赖, 前一帧还在光栅化或写文件时后一帧的几何就可以开始, 一帧的各条也可以并行光栅化.
+// 同时在途的帧数不超过 frames_in_flight, 每个在途帧一份帧缓冲, 三角形缓冲和输出图像, 内存由此封顶.
+// 每条内三角形保持提交顺序, 结果与逐个三角形直接光栅化相同.
+// 提交时保存一份场景的快照, 之后主线程可以移动实例准备下一帧, 不影响在途的帧.
+// 一帧内的临时数据 (三角形, 分箱, 重画的矩形) 放在该帧的 mygl::Arena 上, 几何开始时整体回收;
+// 场景规模稳定之后提交和渲染一帧没有堆分配 (写文件除外, 见 bench::allocations).
+class FramePipeline
+{
+public:
+    // samples 为帧缓冲每像素的采样点数, 4 时做 4x MSAA
+    FramePipeline(Scene &scene, int width, int height, size_t frames_in_flight, mygl::Scheduler &scheduler,
+                  int samples = 1);
+    // 等待所有帧完成
+    ~FramePipeline();
+
+    FramePipeline(const FramePipeline &) = delete;
+    FramePipeline &operator=(const FramePipeline &) = delete;
+
+    // 流式绘制 filename (见 MeshStream), 作为场景中 model 的网格, 只画原点处的一个实例.
+    // 几何阶段边读边光栅化, 不分箱, 内存不随网格增长
+    void set_stream(const char *filename, size_t memory_cap, int model);
+
+    // 每次绘制的着色率 (1, 2 或 4, 见 IShader::shading_rate)
+    void set_shading_rate(int rate) { shading_rate_ = rate; }
+
+    // 自适应着色率: 每帧输出时按图像内容为同一帧缓冲的下一帧选择各分块的着色率
+    // (见 Framebuffer::adapt_shading_rates), 即着色率来自 frames_in_flight 帧之前. threshold <= 0 时关闭
+    void set_adaptive_shading(float threshold) { adaptive_threshold_ = threshold; }
+
+    // 动态分辨率: 按最近完成的一帧各阶段的耗时调整内部渲染分辨率, 使一帧的耗时不超过 budget_ms 毫秒.
+    // 光栅化的耗时按像素数缩放, 几何和输出当作固定开销. 内部分辨率不低于输出的 min_scale 倍,
+    // 输出时双线性放大到输出尺寸. budget_ms <= 0 时关闭, 总是按输出分辨率渲染
+    void set_frame_budget(double budget_ms, float min_scale = 0.25f);
+
+    // 增量重画: 每个帧缓冲记下上一次画到它的那一帧中各实例覆盖的屏幕分块和变换.
+    // 相机, 分辨率都没变时, 只清空并重画变换改变了的实例新旧覆盖范围内的分块, 其余分块沿用上一次的颜色和深度,
+    // 也只有覆盖到这些分块的实例做顶点计算. 结果与整帧重画相同. 流式绘制和自适应着色率时总是整帧重画
+    void set_incremental(bool enabled) { incremental_ = enabled; }
+
+    // 每帧在标准错误输出一行统计 (可见实例数和三角形数, 增量重画时还有重画的分块数和实例数,
+    // 流式绘制时为每批的三角形数和读取内存的峰值), 默认关闭
+    void set_verbose(bool enabled) { verbose_ = enabled; }
+
+    // 提交一帧, 在途的帧已满时等待最早的一帧完成
+    void submit(const Camera &camera, const std::string &image_path, const std::string &zbuffer_path);
+
+    // 等待已提交的帧全部写完
+    void flush();
+
+    // 写失败的帧数
+    size_t failures() const { return failures_; }
+
+    // 各在途帧的临时数据 Arena 向系统申请的总字节数
+    size_t arena_capacity() const;
+
+private:
+    // 顶点着色后的三角形: 裁剪空间坐标和三个顶点的 varying
+    struct ShadedTriangle
+    {
+        Vec4f pts[3];
+        float varying[3][mygl::MAX_VARYINGS];
+        int nvaryings;
+        Model *model;
+        mygl::Rect bounds;      // 屏幕包围盒 (像素, 已裁剪到帧缓冲)
+    };
+
+    // 一帧各阶段的耗时 (毫秒), 光栅化为各条耗时之和除以并行的线程数
+    struct FrameTimes
+    {
+        double geometry = 0;
+        double raster = 0;
+        double output = 0;
+        float scale = 1.f;
+        bool valid = false;
+    };
+
+    struct Slot;
+
+    // 一条光栅化任务的参数, 任务只捕获它的地址, 放得进 std::function 内部不用堆分配
+    struct BandJob
+    {
+        Slot *slot;
+        int band;
+    };
+
+    // 一个在途帧的全部状态
+    struct Slot
+    {
+        int index = 0;
+        int width = 0;          // 内部渲染分辨率, 不做动态分辨率时与输出相同
+        int height = 0;
+        float scale = 1.f;
+        double geometry_ms = 0;
+        std::vector<double> band_ms;
+        Camera camera;
+        Scene scene;            // 提交时的场景快照
+        std::string image_path;
+        std::string zbuffer_path;
+        mygl::View view;
+        GouraudShader shader;
+        std::vector<int> visible;
+        mygl::Arena arena;      // 本帧的临时数据, 几何开始时回收
+        mygl::ArenaVector<ShadedTriangle> triangles;
+        std::vector<mygl::ArenaVector<int>> bins;   // 每条光栅化的三角形编号
+        std::vector<mygl::ArenaVector<mygl::Rect>> rects;   // 每条中要重画的矩形, 整帧重画时为整条
+        std::vector<BandJob> band_jobs;
+        std::vector<unsigned char> dirty;       // 要重画的分块
+        int ndirty = 0;
+        // 帧缓冲中现有内容是怎样画出来的, 用于下一次增量重画
+        bool drawn = false;
+        Camera drawn_camera;
+        int drawn_width = 0;
+        int drawn_height = 0;
+        std::vector<mygl::Rect> drawn_tiles;    // 每个实例覆盖的分块范围, 不可见时为空
+        std::vector<Matrix4f> drawn_transforms;
+        mygl::Framebuffer fb;
+        TGAImage image;
+        TGAImage zbuffer;
+        Image<RGB8> scaled;     // 内部分辨率的图像, 放大到 image / zbuffer
+        Image<Gray8> scaled_depth;
+        memstats::Tracker scaled_memory = memstats::Tracker(memstats::FRAMEBUFFER);
+        bool busy = false;
+        mygl::Scheduler::Task done = 0;
+    };
+
+    // 按最近完成的一帧的耗时选择下一帧的内部分辨率, 必要时重新分配该帧的帧缓冲
+    void resize(Slot &slot);
+    void geometry(Slot &slot);
+    // 按各实例这一帧覆盖的分块求出要重画的分块和矩形并清空它们, 返回是否整帧重画
+    bool invalidate(Slot &slot, const mygl::ArenaVector<mygl::Rect> &tiles);
+    void bin(Slot &slot, ShadedTriangle &tri);
+    void raster(Slot &slot, int band);
+    void output(Slot &slot);
+
+    Scene &scene_;
+    int width_;
+    int height_;
+    int band_;          // 每条的高度, 为分块高度的整数倍 (按输出分辨率划分, 内部分辨率较低时后面的条为空)
+    int nbands_;
+    mygl::Scheduler &scheduler_;
+    std::vector<std::unique_ptr<Slot>> slots_;
+    std::vector<mygl::Scheduler::Task> geometry_task_;  // 提交时复用的依赖列表
+    std::vector<mygl::Scheduler::Task> band_tasks_;
+    int frames_;
+    std::atomic<size_t> failures_;
+
+    int shading_rate_;
+    float adaptive_threshold_;
+    bool incremental_;
+    bool verbose_;
+
+    double budget_ms_;
+    float min_scale_;
+    std::mutex times_mutex_;
+    FrameTimes last_times_;     // 最近完成的一帧
+    float scale_;               // 最近选择的缩放, 只在几何任务中读写, 由 times_mutex_ 保护
+
+    std::string stream_file_;
+    size_t stream_cap_;
+    int stream_model_;
+};
@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <string>
+#include "geometry.h"
+#include "mygl.h"
+#include "model.h"
+#include "fastmath.h"
+
+// 命令行渲染和渲染服务共用的相机, 着色器和绘制循环
+
+// 相机, 默认值与命令行单帧渲染相同
+struct Camera
+{
+    Vec3f eye    = Vec3f(1, 1, 3);
+    Vec3f center = Vec3f(0, 0, 0);
+    Vec3f up     = Vec3f(0, 1, 0);
+};
+
+// 光线的反方向(光线从该点射向原点), 这样方便判断光线是否照到平面. (light_dir点乘法向量 > 0)
+const Vec3f DEFAULT_LIGHT = Vec3f(1, 1, 1);
+
+// 绕 y 轴把相机转一周, 第 i 个 (共 n 个) 位姿, i = 0 时就是 start
+Camera turntable(const Camera &start, int i, int n);
+
+// 多帧输出的文件名 prefix_%03d.tga, 只有一帧时为 prefix.tga
+std::string frameName(const char *prefix, int frame, int frames);
+
+// 相机能否生成有效的视图: 与 mygl::viewMatrix 一样先把 eye 归一化再减去 center 得到视线方向,
+// 视线方向和 up 不能为零或者共线, eye 与 center 不能重合 (投影系数), 分量都是有限值
+bool validCamera(const Camera &camera);
+
+// 相机对应的视图: 视口占帧缓冲中间的 3/4, 投影系数由相机到观察点的距离决定
+mygl::View cameraView(const Camera &camera, int width, int height);
+
+// 渲染一帧 width x height 的图像所需的内存: 帧缓冲和 resolve 输出的颜色 (RGB) 与深度 (灰度) 图像.
+// 渲染服务和批量渲染在分配之前用它判断是否超出内存上限
+size_t frameBytes(int width, int height);
+
+// 法线贴图使用的固定变换, 与相机无关, 同一个模型所有视图共用一份变换好的法线贴图
+Matrix4f normalMatrix();
+
+
+// 采用Gourand着色模型的着色器
+class GouraudShader : public mygl::IShader
+{
+public:
+    // written by vertex shader, read by fragment shader
+    Vec3f varying_intensity;
+
+    Matrix<4, 4, float> uniform_M;   //  Projection*ModelView
+    Matrix<4, 4, float> uniform_MIT; // (Projection*ModelView).invert_transpose()
+    Matrix<4, 4, float> uniform_MVP; //  Viewport*Projection*ModelView*实例变换
+    Vec3f uniform_light;             // 归一化的光线方向 (世界空间)
+    Vec3f uniform_l;                 // 变换并归一化后的光线方向, 每次绘制只算一次
+    Model *model;                    // 当前实例的模型, 多个实例共享
+    const Vertex *vertices;          // 本次绘制的顶点: 模型的顶点缓冲, 或者流式读取的一批三角形
+    const int *indices;              // 本次绘制使用的 LOD 的索引, 为空时每三个顶点为一个三角形
+
+    // 按视图和光线设置 uniform, uniform_MVP 为视图变换 (没有实例变换)
+    void setup(const mygl::View &view, Vec3f light);
+
+    // iface为三角形编号, nthvert为顶点编号, 返回屏幕坐标
+    virtual Vec4f vertex(int iface, int nthvert) override
+    {
+        int k = iface * 3 + nthvert;
+        const Vertex &v = vertices[indices ? indices[k] : k];
+        // 纹理坐标交给光栅化器做透视校正插值
+        nvaryings = 2;
+        varying[nthvert][0] = v.uv[0];
+        varying[nthvert][1] = v.uv[1];
+        varying_intensity[nthvert] = std::max(0.f, v.normal * uniform_light); // get diffuse lighting intensity
+
+        Vec4f gl_Vertex = embed<4>(v.pos, 1.0f); // read the vertex from .obj file
+        return uniform_MVP * gl_Vertex; // transform it to screen coordinates
+    }
+
+    // frag为插值后的片段输入, color为当前像素的颜色, 返回是否丢弃该像素
+    virtual bool fragment(const mygl::Fragment &frag, TGAColor &color) override
+    {
+        // 透视校正插值后的纹理坐标
+        Vec2f uv(frag.varying[0], frag.varying[1]);
+        // 法线(已经在绘制前用 uniform_MIT 变换并归一化), 镜面反射指数, 纹理颜色
+        Vec3f n;
+        float specular;
+        TGAColor diffuse;
+        if (model->has_material())
+        {
+            // 三张贴图交错存放, 一次读取
+            const MaterialTexel &m = model->material(uv);
+            n        = m.normal;
+            specular = m.diffuse.a;
+            diffuse  = m.diffuse;
+        }
+        else
+        {
+            n        = model->view_normal(uv);
+            specular = model->specular(uv);
+            diffuse  = model->getTexture(uv);
+        }
+        // 光的方向
+        const Vec3f &l = uniform_l;
+        // 反射光方向
+        Vec3f r = fastmath::normalize(n * (n * l * 2.f) - l);
+
+        // specular镜面反射
+        // 标量的快速 pow 并不比 std::pow 快, 见 fastmath.h
+        float spec = fastmath::pow<fastmath::Accuracy::EXACT>(std::max(r.z, 0.0f), specular);
+        // 漫反射, 即intensity
+        float diff = std::max(0.f, n * l);
+
+        // color = TGAColor(255, 255, 255) * intensity;
+        color = diffuse * diff;
+        for (int i = 0; i < 3; i ++)
+            // 环境分量系数取5, 漫反射分量系数取1, 镜面反射分量取0.6, 但是通常系数之和要等于1
+            color[i] = fastmath::clamp(5 + color[i] * (1 * diff + 0.6f * spec), 0.f, 255.f);
+
+        // 是否丢弃该像素
+        return false;
+    }
+};
+
+// 用着色器当前的 vertices / indices 画 nfaces 个三角形
+void drawFaces(GouraudShader &shader, int nfaces, mygl::Framebuffer &fb);
+
+// 按包围球中心处每单位长度在屏幕上的像素数选择实例的 LOD
+const Mesh &selectMesh(const mygl::View &view, const Model &model, Vec3f center, float scale);
+
+// 画一个变换为 transform, 缩放为 scale 的实例, 按屏幕尺寸选择 LOD, 返回画出的三角形数.
+// 需要先调用 shader.setup 和 model.prepare_view_normals(normalMatrix())
+long drawInstance(GouraudShader &shader, const mygl::View &view, Model &model, const Matrix4f &transform,
+                  Vec3f center, float scale, mygl::Framebuffer &fb);
@@ -0,0 +1,84 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "geometry.h"
+#include "model.h"
+
+// 屏幕空间的视锥: 由 viewport * projection * modelView 得到左右上下四个平面和 w > 0 的近平面,
+// 范围是整个帧缓冲, 而不是视口矩形. 深度超出范围的片段只会被截断, 所以没有远平面.
+class Frustum
+{
+public:
+    enum Result
+    {
+        OUTSIDE,
+        INTERSECT,
+        INSIDE
+    };
+
+    Frustum(const Matrix4f &m, int width, int height);
+
+    // 轴对齐包围盒与视锥的关系
+    Result classify(const Vec3f &lo, const Vec3f &hi) const;
+
+private:
+    Vec4f planes_[5];   // 点 p 在内侧: planes_[i] * (p, 1) >= 0
+};
+
+
+// 场景: 少量共享的模型 (网格, LOD 和贴图) 加上大量实例, 每个实例只保存变换和世界空间的包围体.
+// 实例包围盒上建一棵 BVH, 绘制前整棵子树一起做视锥剔除, 不可见的实例不做任何顶点计算.
+// 场景可以复制, 渲染流水线每帧保存一份快照, 提交之后就可以移动实例准备下一帧.
+class Scene
+{
+public:
+    struct Instance
+    {
+        int model;
+        Matrix4f transform;     // 模型空间 -> 世界空间
+        Vec3f center;           // 世界空间的包围球
+        float radius;
+        float scale;            // 变换的最大缩放, 用于换算 LOD 的屏幕误差
+    };
+
+    int add_model(std::shared_ptr<Model> model);
+    // 添加实例后需要重新 build()
+    int add_instance(int model, const Matrix4f &transform);
+    // 移动实例, 之后需要 refit() (或者 build())
+    void set_transform(int i, const Matrix4f &transform);
+
+    int nmodels() const { return int(models_.size()); }
+    int ninstances() const { return int(instances_.size()); }
+    Model &model(int i) { return *models_[i]; }
+    const Instance &instance(int i) const { return instances_[i]; }
+
+    // 在实例包围盒上建 BVH
+    void build();
+    // 树的结构不变, 只按实例当前的包围体更新各节点的包围盒. 实例只是小范围移动时比 build() 便宜
+    void refit();
+
+    // 把与视锥相交的实例编号写入 visible (清空后追加), m 为 viewport * projection * modelView
+    void cull(const Matrix4f &m, int width, int height, std::vector<int> &visible) const;
+
+private:
+    static constexpr int LEAF_SIZE = 4;
+
+    // 节点覆盖 order_[first, first + count), 内部节点的子节点为 left 和 left + 1
+    struct Node
+    {
+        Vec3f lo, hi;
+        int first, count;
+        int left;       // 叶子为 -1
+    };
+
+    void build(int index, int first, int count);
+    // 按实例的包围球更新 inst 的变换, 中心, 半径和缩放
+    void place(Instance &inst, const Matrix4f &transform) const;
+    // 节点 [first, first + count) 中实例的包围盒
+    void bounds(Node &node) const;
+
+    std::vector<std::shared_ptr<Model>> models_;
+    std::vector<Instance> instances_;
+    std::vector<Node> nodes_;
+    std::vector<int> order_;
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mygl
+{
+
+// 工作线程池上的任务图: 每个任务带有显式的依赖, 依赖全部完成后才进入就绪队列.
+// 不同帧的任务之间没有依赖时可以交错执行, 例如第 N+1 帧的几何和第 N 帧的光栅化同时进行.
+// 任务不能抛出异常.
+// 任务节点和就绪队列都放在复用的池里, 任务数不超过以前的最大值, 并且 fn 不需要在堆上保存捕获的数据
+// (std::function 只在内部放得下两个指针左右), 添加和执行任务就没有堆分配.
+class Scheduler
+{
+public:
+    // 高 32 位为节点的代数, 低 32 位为节点在池中的位置
+    using Task = uint64_t;
+
+    // nthreads 为 0 时取硬件线程数
+    explicit Scheduler(size_t nthreads = 0);
+    // 等待所有任务完成
+    ~Scheduler();
+
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    // 添加任务, deps 里的任务 (可以已经完成) 全部完成后执行
+    Task add(std::function<void()> fn, const std::vector<Task> &deps = {});
+
+    // 预先分配 tasks 个任务节点和就绪队列, 每个节点可以记下 dependents 个依赖它的任务.
+    // 之后同时未完成的任务和每个任务的后继不超过这些数目时, 添加任务不再分配内存
+    void reserve(size_t tasks, size_t dependents);
+
+    // 等待任务完成
+    void wait(Task task);
+    void wait_all();
+
+    size_t nthreads() const { return threads_.size(); }
+
+private:
+    struct Node
+    {
+        std::function<void()> fn;
+        uint32_t generation = 1;        // 任务完成后加一, 旧的 Task 就不再指向这个节点
+        size_t pending = 0;             // 未完成的依赖数
+        std::vector<uint32_t> dependents;   // 依赖本任务的任务, 节点复用时保留容量
+    };
+
+    // 任务是否还没完成, 调用时需持有 mutex_
+    bool live(Task task) const;
+    void grow_ready(size_t capacity);
+    void push_ready(uint32_t index);
+    void worker();
+
+    std::mutex mutex_;
+    std::condition_variable ready_cv_;
+    std::condition_variable done_cv_;
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> free_;    // 空闲的节点
+    size_t live_ = 0;               // 未完成的任务数
+    // 就绪队列, 环形缓冲, 满时扩大一倍
+    std::vector<uint32_t> ready_;
+    size_t ready_head_ = 0;
+    size_t ready_count_ = 0;
+    std::vector<std::thread> threads_;
+    bool stop_ = false;
+};
+
+} // namespace mygl
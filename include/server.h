@@ -0,0 +1,96 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "json.h"
+#include "model.h"
+#include "render.h"
+
+// 常驻的无界面渲染服务: 从标准输入逐行读取 JSON 渲染任务, 每完成一个任务向标准输出写一行 JSON 结果.
+//   任务  {"id": 7, "model": "../data/african_head.obj", "camera": {"eye": [1, 1, 3], "center": [0, 0, 0], "up": [0, 1, 0]},
+//          "light": [1, 1, 1], "width": 800, "height": 800, "output": "out.tga", "zbuffer": "z.tga", "compress": false,
+//          "memory_mb": 16}
+//         只有 output 是必需的, 其余的默认值与命令行渲染相同. id 可以是任意 JSON 值, 原样写回.
+//   结果  {"id": 7, "ok": true, "output": "out.tga", "faces": 2492, "ms": 12.5, "memory": 5120000}
+//         {"id": 7, "ok": false, "error": "..."}
+// 模型和贴图在任务之间保持加载. 任务在工作线程上并发执行, 结果按完成的顺序输出.
+// 等待中的任务数有上限, 队列满时停止读取输入, 压力经管道传回提交任务的一方.
+// 任务的内存 (帧缓冲, 深度和输出图像等, 见 memstats::Job; 共享的模型和贴图不计入) 超过 memory_mb 时任务失败,
+// 在分配完帧缓冲和图像之后, 光栅化之前检查. 不指定时用服务的默认上限.
+namespace server
+{
+
+struct Job
+{
+    json::Value id;
+    std::string model = "../data/african_head.obj";
+    bool compress = false;
+    Camera camera;
+    Vec3f light = DEFAULT_LIGHT;
+    int width = 800;
+    int height = 800;
+    std::string output;
+    std::string zbuffer;
+    size_t memory_limit = 0;    // 字节, 0 为使用服务的默认上限
+};
+
+constexpr int MAX_SIZE = 8192;
+
+// 检查并读取任务的各个字段, 出错时返回 false 并写入 error
+bool parseJob(const json::Value &request, Job &job, std::string &error);
+
+class RenderServer
+{
+public:
+    // nworkers 为 0 时取硬件线程数, queue_depth 为 0 时取 2 * nworkers.
+    // memory_limit 为任务没有指定 memory_mb 时每个任务的内存上限 (字节), 0 为不限制
+    explicit RenderServer(size_t nworkers = 0, size_t queue_depth = 0, size_t memory_limit = 0);
+
+    RenderServer(const RenderServer &) = delete;
+    RenderServer &operator=(const RenderServer &) = delete;
+
+    // 读到输入结束为止, 等所有任务完成后返回失败的任务数. 加载过的模型保留到对象析构
+    size_t serve(std::istream &in, std::ostream &out);
+
+    // 在调用线程上渲染一个任务并写出图像, memory 为任务内存的峰值. 失败时返回 false 并写入 error
+    bool render(const Job &job, long &faces, size_t &memory, std::string &error);
+
+    size_t nworkers() const { return nworkers_; }
+    size_t queue_depth() const { return queue_depth_; }
+    size_t memory_limit() const { return memory_limit_; }
+
+private:
+    using ModelHandle = std::shared_future<std::shared_ptr<Model>>;
+
+    // 取缓存的模型, 第一次请求时加载并准备好法线贴图, 之后只读共享
+    std::shared_ptr<Model> model(const std::string &path, bool compress);
+    void worker();
+    void reply(const json::Value &id, bool ok, const std::string &body);
+
+    size_t nworkers_;
+    size_t queue_depth_;
+    size_t memory_limit_;
+
+    std::mutex models_mutex_;
+    std::map<std::string, ModelHandle> models_;
+
+    std::mutex mutex_;
+    std::condition_variable queue_cv_;
+    std::condition_variable space_cv_;
+    std::deque<Job> queue_;
+    bool done_ = false;
+    size_t failures_ = 0;
+
+    std::mutex out_mutex_;
+    std::ostream *out_ = nullptr;
+};
+
+// tinyRenderer --server [workers] [queue] [memory MB]
+int run(int argc, char **argv);
+
+} // namespace server
@@ -0,0 +1,182 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "blockcompress.h"
+#include "memstats.h"
+
+// 只读纹理. 加载时把行线性的 TGAImage 一次性转换成指定的存储布局:
+// LINEAR 为原始行序; TILED 为 4x4 分块, 每块16个纹素连续存放;
+// MORTON 为Z序, 相邻的纹素在二维上也相邻.
+// 纹理旋转后相邻片段取的纹素在行序下相隔很远, 分块/Z序可以让它们落在同一缓存行.
+// 也可以以 BC1/BC4/BC5 块压缩的形式常驻内存, 采样时只解码用到的纹素.
+class Texture
+{
+public:
+    enum Layout
+    {
+        LINEAR,
+        TILED,
+        MORTON
+    };
+
+    enum Compression
+    {
+        UNCOMPRESSED,
+        BC1,    // RGB颜色
+        BC4,    // 单通道, 解码后写入所有通道
+        BC5     // 法线的 x/y, z 由单位长度重建
+    };
+
+    static constexpr int TILE = 4;
+
+    Texture();
+    // 压缩纹理总是按 4x4 块存放, 忽略 layout.
+    // BC5 重建的 z 不会小于0, 含有 z < 0 法线的贴图(物体空间法线贴图)退回 BC1.
+    // category 为内存统计中贴图的用途
+    Texture(TGAImage &img, Layout layout = TILED, Compression compression = UNCOMPRESSED,
+            memstats::Category category = memstats::TEXTURE);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int bytespp() const { return bytespp_; }
+    Layout layout() const { return layout_; }
+    Compression compression() const { return compression_; }
+    bool empty() const { return data_.empty(); }
+    // 常驻内存的字节数
+    size_t bytes() const { return data_.size(); }
+
+    // 纹素在存储中的下标, 坐标必须在范围内
+    size_t index(int x, int y) const
+    {
+        switch (layout_)
+        {
+        case TILED:
+            return tiled_index<TILE>(x, y, tiles_x_);
+        case MORTON:
+            return morton_index(x, y);
+        default:
+            return size_t(x) + size_t(y) * width_;
+        }
+    }
+
+    // 取纹素, 坐标越界时返回黑色(与 TGAImage::get 一致)
+    TGAColor fetch(int x, int y) const
+    {
+        if (x < 0 || y < 0 || x >= width_ || y >= height_ || data_.empty())
+            return TGAColor();
+        if (compression_ != UNCOMPRESSED)
+            return fetch_compressed(x, y);
+        return TGAColor(data_.data() + index(x, y) * bytespp_, bytespp_);
+    }
+
+    // 最近邻采样, uv 范围 [0, 1)
+    TGAColor sample(Vec2f uv) const
+    {
+        return fetch(int(uv[0] * width_), int(uv[1] * height_));
+    }
+
+    // 转换回行线性的 TGAImage
+    TGAImage to_image() const;
+
+private:
+    TGAColor fetch_compressed(int x, int y) const;
+    void compress(TGAImage &img);
+
+    std::vector<unsigned char> data_;
+    memstats::Tracker memory_;
+    int width_;
+    int height_;
+    int bytespp_;
+    int tiles_x_;
+    Layout layout_;
+    Compression compression_;
+    int block_bytes_;
+};
+
+
+// 预解码的法线贴图: 加载时把 unorm 编码的 BGR 纹素解码, 做一次 proj<3>(m * embed<4>(n)) 变换并归一化,
+// 按八面体映射存成两个 16 位分量 (4 字节/纹素, 与 TGA 原图相当).
+// 片段着色时只需要一次读取和几次加法, 不再做 swizzle, 类型转换, 重新映射和矩阵变换.
+class NormalMap
+{
+public:
+    NormalMap();
+    explicit NormalMap(const Texture &tex, const Matrix4f &m = Matrix4f::identity());
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    bool empty() const { return data_.empty(); }
+    size_t bytes() const { return data_.size() * sizeof(uint32_t); }
+
+    // 与 Texture::sample 相同的最近邻取法, 越界时返回黑色纹素解码出的法线
+    Vec3f sample(Vec2f uv) const
+    {
+        int x = int(uv[0] * width_), y = int(uv[1] * height_);
+        if (x < 0 || y < 0 || x >= width_ || y >= height_)
+            return outside_;
+        return decode(data_[size_t(y) * width_ + x]);
+    }
+
+    // 单位向量与八面体编码互相转换, 低 16 位为 x, 高 16 位为 y
+    static uint32_t encode(Vec3f n);
+    static Vec3f decode(uint32_t e)
+    {
+        float x = (e & 0xffff) * (2.f / 65535.f) - 1.f, y = (e >> 16) * (2.f / 65535.f) - 1.f;
+        float z = 1.f - std::abs(x) - std::abs(y);
+        // 下半球折叠到了外侧的四个三角形里
+        float t = std::max(-z, 0.f);
+        x += x >= 0.f ? -t : t;
+        y += y >= 0.f ? -t : t;
+        Vec3f n(x, y, z);
+        return n * (1.f / std::sqrt(x * x + y * y + z * z));
+    }
+
+private:
+    std::vector<uint32_t> data_;
+    memstats::Tracker memory_ = memstats::Tracker(memstats::NORMAL_MAP);
+    int width_;
+    int height_;
+    Vec3f outside_;
+};
+
+
+// 交错存放的材质纹素: 一次读取同时得到法线, 漫反射颜色和镜面反射指数
+struct MaterialTexel
+{
+    Vec3f normal;
+    TGAColor diffuse;   // a 通道存放镜面反射指数
+};
+
+// 漫反射, 镜面反射和法线三张贴图分辨率相同时, 按纹素交错成一张16字节/纹素的贴图,
+// 一个片段只访问一条缓存行, 而不是三张贴图各一次.
+class MaterialMap
+{
+public:
+    MaterialMap();
+    MaterialMap(const Texture &diffuse, const Texture &specular, const NormalMap &normals);
+
+    // 三张贴图分辨率一致时才能交错
+    static bool compatible(const Texture &diffuse, const Texture &specular, const NormalMap &normals);
+
+    bool empty() const { return data_.empty(); }
+    size_t bytes() const { return data_.size() * sizeof(MaterialTexel); }
+
+    const MaterialTexel &sample(Vec2f uv) const
+    {
+        int x = int(uv[0] * width_), y = int(uv[1] * height_);
+        if (x < 0 || y < 0 || x >= width_ || y >= height_)
+            return outside_;
+        return data_[size_t(y) * width_ + x];
+    }
+
+private:
+    std::vector<MaterialTexel> data_;
+    memstats::Tracker memory_ = memstats::Tracker(memstats::MATERIAL_MAP);
+    int width_;
+    int height_;
+    MaterialTexel outside_;
+};
@@ -3,6 +3,9 @@
 
 #include <fstream>
 #include <cassert>
+#include <variant>
+#include "image.h"
+#include "memstats.h"
 
 #pragma pack(push, 1)
 struct TGA_Header
@@ -22,89 +25,18 @@ struct TGA_Header
 };
 #pragma pack(pop)
 
-struct TGAColor
-{
-	union
-	{
-		struct
-		{
-			unsigned char b, g, r, a;
-		};
-		unsigned char raw[4];
-		unsigned int val;
-	};
-	int bytespp;
-
-	TGAColor() : val(0), bytespp(1)
-	{
-	}
-
-	TGAColor(unsigned char v) : raw(), bytespp(1)
-	{
-        for (int i = 0; i < 4; i ++)
-			raw[i] = v;
-        raw[0] = v;
-    }
-
-	TGAColor(unsigned char R, unsigned char G, unsigned char B) : b(B), g(G), r(R), a(0), bytespp(4)
-	{
-	}
-
-	TGAColor(unsigned char R, unsigned char G, unsigned char B, unsigned char A) : b(B), g(G), r(R), a(A), bytespp(4)
-	{
-	}
-
-	TGAColor(int v, int bpp) : val(v), bytespp(bpp)
-	{
-	}
-
-	TGAColor(const TGAColor &c) : val(c.val), bytespp(c.bytespp)
-	{
-	}
-
-	TGAColor(const unsigned char *p, int bpp) : val(0), bytespp(bpp)
-	{
-		for (int i = 0; i < bpp; i++)
-		{
-			raw[i] = p[i];
-		}
-	}
-
-	TGAColor& operator=(const TGAColor &c)
-	{
-		if (this != &c)
-		{
-			bytespp = c.bytespp;
-			val = c.val;
-		}
-		return *this;
-	}
-
-	TGAColor operator *(float intensity) const {
-        TGAColor res = *this;
-        intensity = (intensity > 1.f ? 1.f : (intensity < 0.f ? 0.f : intensity));
-		res.b = static_cast<unsigned char>(b * intensity);
-		res.r = static_cast<unsigned char>(r * intensity);
-		res.g = static_cast<unsigned char>(g * intensity);
-		res.a = static_cast<unsigned char>(a * intensity);
-        return res;
-	}
-
-	unsigned char& operator[] (const int idx)
-	{
-		assert(idx >= 0 && idx < 4);
-		return raw[idx];
-	}
-};
-
+// TGA文件读写适配器, 像素存储在对应格式的 Image<Format> 中
 class TGAImage
 {
 protected:
-	unsigned char *data;
+	std::variant<std::monostate, Image<Gray8>, Image<RGB8>, Image<RGBA8>> storage;
+	unsigned char *data;	// 指向 storage 中的像素数据
+	memstats::Tracker memory = memstats::Tracker(memstats::IO);
 	int width;
 	int height;
 	int bytespp;
 
+	void allocate(int w, int h, int bpp);
 	bool load_rle_data(std::ifstream &in);
 	bool unload_rle_data(std::ofstream &out);
 
@@ -119,6 +51,7 @@ public:
 	TGAImage();
 	TGAImage(int w, int h, int bpp);
 	TGAImage(const TGAImage &img);
+	TGAImage(TGAImage &&img);
 	bool read_tga_file(const char *filename);
 	bool write_tga_file(const char *filename, bool rle = true);
 	bool flip_horizontally();
@@ -128,6 +61,15 @@ public:
 	bool set(int x, int y, TGAColor c);
 	~TGAImage();
 	TGAImage &operator=(const TGAImage &img);
+	TGAImage &operator=(TGAImage &&img);
+
+	// 取出底层的类型化存储, 格式不匹配时抛出 std::bad_variant_access
+	template <class PixelFormat>
+	Image<PixelFormat> &as()
+	{
+		return std::get<Image<PixelFormat>>(storage);
+	}
+
 	int get_width();
 	int get_height();
 	int get_bytespp();
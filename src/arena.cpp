@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include "arena.h"
+
+mygl::Arena::Arena(size_t block_bytes) : block_bytes_(std::max<size_t>(block_bytes, 256)), current_(0), offset_(0), peak_(0)
+{
+}
+
+void *mygl::Arena::allocate(size_t bytes, size_t align)
+{
+    for (;;)
+    {
+        if (current_ < blocks_.size())
+        {
+            Block &block = blocks_[current_];
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+            size_t start = ((base + offset_ + align - 1) & ~uintptr_t(align - 1)) - base;
+            if (start + bytes <= block.size)
+            {
+                offset_ = start + bytes;
+                peak_   = std::max(peak_, used());
+                return block.data.get() + start;
+            }
+            // 放不下时依次试后面的块 (rewind 之后还留着), 都放不下再新开一块
+            if (current_ + 1 < blocks_.size())
+            {
+                current_ ++;
+                offset_ = 0;
+                continue;
+            }
+        }
+        size_t size = std::max(block_bytes_, bytes + align);
+        blocks_.push_back(Block{std::unique_ptr<unsigned char[]>(new unsigned char[size]), size});
+        memory_.set(capacity());
+        current_ = blocks_.size() - 1;
+        offset_  = 0;
+    }
+}
+
+void mygl::Arena::reset()
+{
+    // 用过不止一块时合并成一块, 按历史最大用量留一点余量, 之后同样的分配序列不再新开块
+    if (blocks_.size() > 1)
+    {
+        size_t size = std::max(block_bytes_, peak_ + peak_ / 16);
+        blocks_.clear();
+        blocks_.push_back(Block{std::unique_ptr<unsigned char[]>(new unsigned char[size]), size});
+        memory_.set(size);
+    }
+    current_ = 0;
+    offset_  = 0;
+}
+
+void mygl::Arena::rewind(Marker marker)
+{
+    if (marker.block == 0 && marker.offset == 0)
+    {
+        reset();
+        return;
+    }
+    current_ = marker.block;
+    offset_  = marker.offset;
+}
+
+size_t mygl::Arena::used() const
+{
+    size_t n = offset_;
+    for (size_t i = 0; i < current_ && i < blocks_.size(); i ++)
+        n += blocks_[i].size;
+    return n;
+}
+
+size_t mygl::Arena::capacity() const
+{
+    size_t n = 0;
+    for (const Block &block : blocks_)
+        n += block.size;
+    return n;
+}
+
+mygl::Arena &mygl::threadArena()
+{
+    thread_local Arena arena;
+    return arena;
+}
+
+
+// --------------- 全局 new / delete 计数 --------------- //
+
+namespace
+{
+std::atomic<size_t> g_allocations(0);
+std::atomic<size_t> g_frees(0);
+std::atomic<size_t> g_bytes(0);
+
+void *countedAlloc(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_bytes.fetch_add(size, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void countedFree(void *p)
+{
+    if (!p)
+        return;
+    g_frees.fetch_add(1, std::memory_order_relaxed);
+    std::free(p);
+}
+}
+
+mygl::HeapCounters mygl::heapCounters()
+{
+    return HeapCounters{g_allocations.load(std::memory_order_relaxed), g_frees.load(std::memory_order_relaxed),
+                        g_bytes.load(std::memory_order_relaxed)};
+}
+
+void *operator new(size_t size)
+{
+    if (void *p = countedAlloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    if (void *p = countedAlloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAlloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAlloc(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    countedFree(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    countedFree(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    countedFree(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    countedFree(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    countedFree(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    countedFree(p);
+}
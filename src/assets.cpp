@@ -0,0 +1,214 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "assets.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+// 缓存的键: 规范化的路径, 同一个文件用不同的相对路径引用时也只加载一次
+std::string canonical(const std::string &path)
+{
+    std::error_code ec;
+    fs::path p = fs::weakly_canonical(path, ec);
+    return ec ? path : p.string();
+}
+
+// 第一个材质中的贴图, 贴图选项 (-bm 1.0 等) 跳过, 只取最后一项文件名
+void parseMtl(const fs::path &mtl, MaterialPaths &paths)
+{
+    std::ifstream in(mtl);
+    std::string line;
+    int materials = 0;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        std::istringstream iss(line);
+        std::string key, token, file;
+        iss >> key;
+        if (key == "newmtl" && ++ materials > 1)
+            break;
+        while (iss >> token)
+            file = token;
+        if (file.empty())
+            continue;
+        std::string resolved = (mtl.parent_path() / file).string();
+        if (key == "map_Kd")
+            paths.diffuse = resolved;
+        else if (key == "map_Ks")
+            paths.specular = resolved;
+        else if (key == "map_Bump" || key == "map_bump" || key == "bump" || key == "norm")
+            paths.normal = resolved;
+    }
+}
+
+// 读入TGA并翻转成纹理坐标的方向, 与原来 Model::load_texture 的输出一致
+bool readTexture(const std::string &path, TGAImage &img)
+{
+    bool status = img.read_tga_file(path.c_str());
+    std::ostringstream msg;
+    msg << "load " << path << " status: " << (status ? "ok" : "failed") << "\n";
+    std::cout << msg.str() << std::flush;
+    if (status)
+        img.flip_vertically();
+    return status;
+}
+}
+
+MaterialPaths resolve_material(const std::string &obj)
+{
+    fs::path path(obj);
+    fs::path dir = path.parent_path();
+    MaterialPaths paths;
+
+    // mtllib 一般在文件开头, 读到第一个顶点就停止
+    std::ifstream in(obj);
+    std::string line;
+    while (std::getline(in, line) && line.compare(0, 2, "v "))
+    {
+        if (!line.compare(0, 7, "mtllib "))
+        {
+            std::string name = line.substr(7);
+            while (!name.empty() && (name.back() == '\r' || name.back() == ' '))
+                name.pop_back();
+            parseMtl(dir / name, paths);
+            break;
+        }
+    }
+
+    std::string stem = path.stem().string();
+    if (paths.diffuse.empty())
+        paths.diffuse = (dir / (stem + "_diffuse.tga")).string();
+    if (paths.specular.empty())
+        paths.specular = (dir / (stem + "_spec.tga")).string();
+    if (paths.normal.empty())
+        paths.normal = (dir / (stem + "_nm.tga")).string();
+    return paths;
+}
+
+AssetManager::AssetManager(size_t nthreads) : stop_(false)
+{
+    if (nthreads == 0)
+        nthreads = std::max(2u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < nthreads; i ++)
+        threads_.emplace_back(&AssetManager::worker, this);
+}
+
+AssetManager::~AssetManager()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread &t : threads_)
+        t.join();
+}
+
+AssetManager &AssetManager::shared()
+{
+    static AssetManager instance;
+    return instance;
+}
+
+// 队列里剩下的任务做完才退出, 保证已经发出的 future 都有结果
+void AssetManager::worker()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+            if (tasks_.empty())
+                return;
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+template <class T>
+AssetManager::Handle<T> AssetManager::load(std::map<std::string, Handle<T>> &cache, const std::string &key,
+                                           std::function<std::shared_ptr<const T>()> loader)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = cache.find(key);
+    if (it != cache.end())
+        return it->second;
+
+    // 加载失败 (得到 nullptr) 的从缓存中去掉, 已经拿到的 handle 仍然得到 nullptr, 之后的请求重新加载.
+    // 这时 future 还没有就绪, collect() 不会去掉这一项, 缓存中 key 对应的一定是这次的 handle
+    auto task = std::make_shared<std::packaged_task<std::shared_ptr<const T>()>>(
+        [this, &cache, key, loader = std::move(loader)]
+        {
+            std::shared_ptr<const T> asset = loader();
+            if (!asset)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                cache.erase(key);
+            }
+            return asset;
+        });
+    Handle<T> handle = task->get_future().share();
+    cache.emplace(key, handle);
+    tasks_.push_back([task] { (*task)(); });
+    cv_.notify_one();
+    return handle;
+}
+
+AssetManager::Handle<Texture> AssetManager::texture(const std::string &path, Texture::Layout layout,
+                                                    Texture::Compression compression, memstats::Category category)
+{
+    std::string file = canonical(path);
+    std::string key = file + "|" + std::to_string(layout) + "|" + std::to_string(compression);
+    return load<Texture>(textures_, key, [file, layout, compression, category]
+    {
+        TGAImage img;
+        readTexture(file, img);
+        return std::make_shared<const Texture>(img, layout, compression, category);
+    });
+}
+
+AssetManager::Handle<MeshAsset> AssetManager::mesh(const std::string &path, bool optimize)
+{
+    std::string file = canonical(path);
+    std::string key = file + (optimize ? "|optimized" : "|raw");
+    return load<MeshAsset>(meshes_, key, [file, optimize]
+    {
+        return std::shared_ptr<const MeshAsset>(MeshAsset::load(file.c_str(), optimize));
+    });
+}
+
+size_t AssetManager::collect()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t released = 0;
+    auto sweep = [&released](auto &cache)
+    {
+        for (auto it = cache.begin(); it != cache.end();)
+        {
+            bool ready = it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            if (ready && it->second.get().use_count() <= 1)
+            {
+                it = cache.erase(it);
+                released ++;
+            }
+            else
+                ++ it;
+        }
+    };
+    sweep(textures_);
+    sweep(meshes_);
+    return released;
+}
+
+size_t AssetManager::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return textures_.size() + meshes_.size();
+}
@@ -0,0 +1,168 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include "batch.h"
+#include "memstats.h"
+
+bool batch::loadPoses(const char *path, std::vector<Camera> &poses, std::string &error)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        error = std::string("can't open ") + path;
+        return false;
+    }
+    std::vector<Camera> result;
+    std::string line;
+    for (int lineno = 1; std::getline(in, line); lineno ++)
+    {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        std::istringstream iss(line);
+        float v[9];
+        int n = 0;
+        while (n < 9 && iss >> v[n])
+            n ++;
+        iss >> std::ws;
+        Camera camera;
+        if ((n != 3 && n != 6 && n != 9) || !iss.eof())
+        {
+            error = std::string(path) + ":" + std::to_string(lineno) + ": expected 3, 6 or 9 numbers";
+            return false;
+        }
+        camera.eye = Vec3f(v[0], v[1], v[2]);
+        if (n >= 6)
+            camera.center = Vec3f(v[3], v[4], v[5]);
+        if (n == 9)
+            camera.up = Vec3f(v[6], v[7], v[8]);
+        if (!validCamera(camera))
+        {
+            error = std::string(path) + ":" + std::to_string(lineno) + ": camera eye, center and up are degenerate";
+            return false;
+        }
+        result.push_back(camera);
+    }
+    poses.swap(result);
+    return true;
+}
+
+batch::Stats batch::render(Model &model, const std::vector<Camera> &poses, int width, int height, size_t nthreads,
+                           size_t memory_limit)
+{
+    // 法线贴图的变换与相机无关, 开始前做一次, 之后模型只读
+    model.prepare_view_normals(normalMatrix());
+
+    int nviews = int(poses.size());
+    std::atomic<int> next(0);
+    std::atomic<long> faces(0);
+    std::atomic<size_t> failures(0);
+    memstats::Job usage(memory_limit);
+
+    // 分配之前按每个线程的用量估算放得下几个线程
+    Stats stats;
+    size_t perThread = frameBytes(width, height);
+    if (memory_limit > 0)
+    {
+        if (perThread > memory_limit)
+        {
+            std::cerr << "batch needs " << perThread << " bytes per thread, over the memory limit of " << memory_limit
+                      << std::endl;
+            stats.failures = size_t(nviews);
+            return stats;
+        }
+        nthreads = std::min(nthreads, memory_limit / perThread);
+    }
+
+    auto worker = [&]
+    {
+        memstats::JobScope scope(usage);
+        // 每个线程一份帧缓冲和输出图像, 视图之间复用
+        mygl::Framebuffer fb(width, height);
+        TGAImage image(width, height, TGAImage::RGB);
+        TGAImage zbuffer(width, height, TGAImage::GRAYSCALE);
+
+        for (int i; (i = next.fetch_add(1)) < nviews; )
+        {
+            mygl::View view = cameraView(poses[i], width, height);
+            GouraudShader shader;
+            shader.setup(view, DEFAULT_LIGHT);
+            fb.clear();
+            faces += drawInstance(shader, view, model, Matrix4f::identity(), model.center(), 1.f, fb);
+
+            fb.resolve(image.as<RGB8>(), zbuffer.as<Gray8>());
+            image.flip_vertically();
+            zbuffer.flip_vertically();
+            std::string imagePath = frameName("output", i, nviews), zbufferPath = frameName("zbuffer", i, nviews);
+            if (!image.write_tga_file(imagePath.c_str()) || !zbuffer.write_tga_file(zbufferPath.c_str()))
+            {
+                std::cerr << "failed to write frame " << imagePath << "\n";
+                failures ++;
+            }
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < nthreads; t ++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &t : threads)
+        t.join();
+
+    stats.seconds  = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.faces    = faces;
+    stats.failures = failures;
+    stats.threads  = nthreads;
+    stats.memory   = usage.peak();
+    return stats;
+}
+
+int batch::run(int argc, char **argv)
+{
+    if (argc < 1)
+    {
+        std::cerr << "usage: tinyRenderer --batch <n | poses.txt> [threads] [memory MB]" << std::endl;
+        return 1;
+    }
+    std::vector<Camera> poses;
+    char *end;
+    long n = std::strtol(argv[0], &end, 10);
+    if (*end == '\0' && n > 0)
+    {
+        for (int i = 0; i < n; i ++)
+            poses.push_back(turntable(Camera(), i, int(n)));
+    }
+    else
+    {
+        std::string error;
+        if (!loadPoses(argv[0], poses, error))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+    }
+    if (poses.empty())
+    {
+        std::cerr << "no camera poses" << std::endl;
+        return 1;
+    }
+    size_t nthreads = argc > 1 ? size_t(std::max(1, std::atoi(argv[1]))) : std::max(1u, std::thread::hardware_concurrency());
+    size_t memory = argc > 2 ? size_t(std::max(0.0, std::atof(argv[2])) * 1024 * 1024) : 0;
+
+    Model model("../data/african_head.obj");
+    if (model.nfaces() == 0)
+        return 1;
+    const int width = 800, height = 800;
+    Stats stats = render(model, poses, width, height, nthreads, memory);
+    if (stats.threads == 0)
+        return 1;
+    std::cerr << "# batch: " << poses.size() << " views, " << stats.threads << " / " << nthreads << " threads, "
+              << stats.seconds << " s, " << poses.size() / stats.seconds << " fps, " << stats.memory / 1024
+              << " KB frame memory" << std::endl;
+    return stats.failures == 0 ? 0 : 1;
+}
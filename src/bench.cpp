@@ -0,0 +1,765 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include "bench.h"
+#include "texture.h"
+#include "fastmath.h"
+#include "model.h"
+#include "meshopt.h"
+#include "mygl.h"
+#include "assets.h"
+#include "imageops.h"
+#include "render.h"
+#include "pipeline.h"
+#include "scene.h"
+#include "arena.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+}
+
+// 模拟屏幕上一块 512x512 区域按光栅顺序采样一张旋转过的纹理,
+// 每个屏幕像素大约对应一个纹素, 角度越接近90度, 行序布局下相邻像素跨行越多.
+int bench::textureLayouts(const char *filename)
+{
+    TGAImage img;
+    if (!img.read_tga_file(filename))
+        return 1;
+
+    const Texture::Layout layouts[] = {Texture::LINEAR, Texture::TILED, Texture::MORTON};
+    const char *names[] = {"linear", "tiled", "morton"};
+    Texture textures[3];
+    for (int i = 0; i < 3; i ++)
+        textures[i] = Texture(img, layouts[i]);
+
+    const int size = 512;
+    const int reps = 8;
+    unsigned int checksum = 0;
+
+    std::printf("%-8s %10s %10s %10s   (ns / sample)\n", "angle", names[0], names[1], names[2]);
+    for (int deg = 0; deg <= 180; deg += 15)
+    {
+        float a = deg * float(M_PI) / 180.f;
+        float c = std::cos(a), s = std::sin(a);
+        std::printf("%-8d", deg);
+        for (int i = 0; i < 3; i ++)
+        {
+            const Texture &tex = textures[i];
+            float scale = 1.f / tex.width();
+            auto start = Clock::now();
+            for (int r = 0; r < reps; r ++)
+            {
+                for (int y = 0; y < size; y ++)
+                {
+                    for (int x = 0; x < size; x ++)
+                    {
+                        float dx = x - size / 2.f, dy = y - size / 2.f;
+                        Vec2f uv(.5f + (dx * c - dy * s) * scale, .5f + (dx * s + dy * c) * scale);
+                        checksum += tex.sample(uv).val;
+                    }
+                }
+            }
+            std::printf(" %10.2f", elapsedMs(start) * 1e6 / (double(reps) * size * size));
+        }
+        std::printf("\n");
+    }
+    std::printf("checksum %u\n", checksum);
+    return 0;
+}
+
+// 三张贴图各自的均方误差换算成 PSNR (dB)
+static double psnr(const Texture &ref, const Texture &tex)
+{
+    double err = 0;
+    int channels = ref.bytespp() == 1 ? 1 : 3;
+    for (int y = 0; y < ref.height(); y ++)
+    {
+        for (int x = 0; x < ref.width(); x ++)
+        {
+            TGAColor a = ref.fetch(x, y), b = tex.fetch(x, y);
+            for (int c = 0; c < channels; c ++)
+                err += double(a[c] - b[c]) * (a[c] - b[c]);
+        }
+    }
+    err /= double(ref.width()) * ref.height() * channels;
+    return err == 0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / err);
+}
+
+// 压缩前后各贴图的大小和误差, 以及模型在未压缩, 未压缩加材质贴图和压缩三种方式下
+// 常驻的贴图内存和 GouraudShader::fragment 的耗时 (与渲染时走同样的采样路径)
+int bench::compressedTextures(const char *filename)
+{
+    MaterialPaths paths = resolve_material(filename);
+    const std::string files[3] = {paths.diffuse, paths.specular, paths.normal};
+    const char *names[3] = {"diffuse", "specular", "normal"};
+    const Texture::Compression codecs[3] = {Texture::BC1, Texture::BC4, Texture::BC5};
+    size_t raw_bytes = 0, packed_bytes = 0;
+    for (int i = 0; i < 3; i ++)
+    {
+        TGAImage img;
+        if (!img.read_tga_file(files[i].c_str()))
+            return 1;
+        Texture raw(img, Texture::LINEAR), packed(img, Texture::LINEAR, codecs[i]);
+        raw_bytes    += raw.bytes();
+        packed_bytes += packed.bytes();
+        const char *codec = packed.compression() == Texture::BC1 ? "BC1" :
+                            packed.compression() == Texture::BC4 ? "BC4" : "BC5";
+        std::printf("%-9s %s %9zu -> %8zu bytes  PSNR %.2f dB\n",
+                    names[i], codec, raw.bytes(), packed.bytes(), psnr(raw, packed));
+    }
+    std::printf("total     %13zu -> %8zu bytes  (%.2fx)\n", raw_bytes, packed_bytes, double(raw_bytes) / packed_bytes);
+
+    struct Config
+    {
+        const char *label;
+        bool compress;
+        bool material;
+    };
+    const Config configs[3] = {{"uncompressed", false, false}, {"material map", false, true}, {"compressed", true, false}};
+    mygl::View view = cameraView(Camera(), 800, 800);
+    const int size = 512;
+    const int reps = 4;
+    unsigned int checksum = 0;
+    for (const Config &config : configs)
+    {
+        // 每种方式用自己的 AssetManager, 贴图不共享, 常驻内存为加载并准备好法线前后的差
+        size_t before = memstats::total().current;
+        AssetManager assets;
+        Model model(filename, Texture::LINEAR, config.compress, true, &assets, false);
+        model.set_material(config.material);
+        model.prepare_view_normals(normalMatrix());
+        size_t resident = memstats::total().current - before;
+
+        GouraudShader shader;
+        shader.setup(view, DEFAULT_LIGHT);
+        shader.model = &model;
+        mygl::Fragment frag = {};
+        TGAColor color;
+        auto start = Clock::now();
+        for (int r = 0; r < reps; r ++)
+        {
+            for (int y = 0; y < size; y ++)
+            {
+                for (int x = 0; x < size; x ++)
+                {
+                    frag.varying[0] = (x + .5f) / size;
+                    frag.varying[1] = (y + .5f) / size;
+                    shader.fragment(frag, color);
+                    checksum += color.val;
+                }
+            }
+        }
+        double ms = elapsedMs(start);
+        std::printf("%-13s %9zu bytes resident  %8.2f ns / fragment  %8.2f Mfragments/s\n", config.label, resident,
+                    ms * 1e6 / (double(reps) * size * size), double(reps) * size * size / (ms * 1e3));
+    }
+    std::printf("checksum %u\n", checksum);
+    return 0;
+}
+
+namespace
+{
+// 各函数在给定区间上相对 double 精度结果的最大相对误差
+template <fastmath::Accuracy A>
+void fastmathErrors(const char *name)
+{
+    using namespace fastmath;
+    double e_exp = 0, e_log = 0, e_pow = 0, e_rsq = 0, e_simd = 0;
+    const int n = 1 << 20;
+    for (int i = 0; i < n; i ++)
+    {
+        float t = (i + .5f) / n;
+        float x = -20.f + 40.f * t;                     // exp2: [-20, 20]
+        e_exp = std::max(e_exp, std::abs(exp2<A>(x) / std::exp2(double(x)) - 1));
+
+        float y = std::ldexp(1.f + t, (i % 41) - 20);  // log2: 跨越多个数量级
+        if (std::abs(y - 1.f) > 1e-3f)
+            e_log = std::max(e_log, std::abs(log2<A>(y) / std::log2(double(y)) - 1));
+
+        float b = t, p = float(i % 256);                // pow: 着色器里的 pow(r.z, specular)
+        double ref = std::pow(double(b), double(p));
+        if (ref > 1e-6)
+            e_pow = std::max(e_pow, std::abs(fastmath::pow<A>(b, p) / ref - 1));
+
+        float r = std::ldexp(1.f + t, (i % 41) - 20);
+        e_rsq = std::max(e_rsq, std::abs(rsqrt<A>(r) * std::sqrt(double(r)) - 1));
+
+#if defined(__SSE2__)
+        float lane[4];
+        _mm_storeu_ps(lane, exp2_ps<A>(_mm_set1_ps(x)));
+        e_simd = std::max(e_simd, std::abs(lane[0] / std::exp2(double(x)) - 1));
+        _mm_storeu_ps(lane, pow_ps<A>(_mm_set1_ps(b), _mm_set1_ps(p)));
+        if (ref > 1e-6)
+            e_simd = std::max(e_simd, std::abs(lane[0] / ref - 1));
+#endif
+    }
+    std::printf("%-8s exp2 %.2e  log2 %.2e  pow %.2e  rsqrt %.2e  simd(exp2/pow) %.2e\n",
+                name, e_exp, e_log, e_pow, e_rsq, e_simd);
+}
+
+template <fastmath::Accuracy A>
+void fastmathTiming(const char *name)
+{
+    const int n = 1 << 22;
+    volatile float sink = 0;
+    float acc = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < n; i ++)
+        acc += fastmath::pow<A>((i & 1023) / 1024.f, float(i & 63));
+    double scalar = elapsedMs(start) * 1e6 / n;
+    sink = acc;
+
+    // 着色器原来调用的是 double 版本的 pow
+    double libm = 0;
+    if (A == fastmath::Accuracy::EXACT)
+    {
+        double dacc = 0;
+        start = Clock::now();
+        for (int i = 0; i < n; i ++)
+            dacc += ::pow(double((i & 1023) / 1024.f), double(i & 63));
+        libm = elapsedMs(start) * 1e6 / n;
+        sink = float(dacc);
+    }
+
+    double simd = 0;
+#if defined(__SSE2__)
+    __m128 vacc = _mm_setzero_ps();
+    __m128 step = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+    start = Clock::now();
+    for (int i = 0; i < n; i += 4)
+    {
+        __m128 x = _mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(i & 1023)), step), _mm_set1_ps(1.f / 1024.f));
+        vacc = _mm_add_ps(vacc, fastmath::pow_ps<A>(x, _mm_set1_ps(float(i & 63))));
+    }
+    simd = elapsedMs(start) * 1e6 / n;
+    sink = _mm_cvtss_f32(vacc);
+#endif
+    (void)sink;
+    std::printf("%-8s pow: scalar %.2f ns  simd %.2f ns (per value)", name, scalar, simd);
+    if (libm > 0)
+        std::printf("  double pow %.2f ns", libm);
+    std::printf("\n");
+}
+}
+
+int bench::fastMath()
+{
+    using fastmath::Accuracy;
+    fastmathErrors<Accuracy::EXACT>("exact");
+    fastmathErrors<Accuracy::FAST>("fast");
+    fastmathErrors<Accuracy::FASTEST>("fastest");
+    fastmathTiming<Accuracy::EXACT>("exact");
+    fastmathTiming<Accuracy::FAST>("fast");
+    fastmathTiming<Accuracy::FASTEST>("fastest");
+    return 0;
+}
+
+namespace
+{
+// 只做纹理采样的着色器, 统计实际着色的片段数
+class TexturedShader : public mygl::IShader
+{
+public:
+    Model *model;
+    const Mesh *mesh;
+    Matrix4f transform;
+    long shaded = 0;
+
+    Vec4f vertex(int iface, int nthvert) override
+    {
+        const Vertex &v = model->vertices()[mesh->indices[iface * 3 + nthvert]];
+        nvaryings = 2;
+        varying[nthvert][0] = v.uv[0];
+        varying[nthvert][1] = v.uv[1];
+        return transform * embed<4>(v.pos, 1.f);
+    }
+
+    bool fragment(const mygl::Fragment &frag, TGAColor &color) override
+    {
+        shaded ++;
+        color = model->getTexture(Vec2f(frag.varying[0], frag.varying[1]));
+        return false;
+    }
+};
+}
+
+// 原始面顺序与优化后顺序的 ACMR, 以及绕模型一周若干视角下的帧耗时和着色片段数
+int bench::meshOrder(const char *filename)
+{
+    const int size = 800;
+    const int views = 16;
+    const int reps = 4;
+    const char *names[] = {"file order", "optimized"};
+
+    std::printf("%-11s %8s %8s %12s %14s\n", "", "acmr", "verts", "ms / frame", "frags / frame");
+    for (int k = 0; k < 2; k ++)
+    {
+        Model model(filename, Texture::LINEAR, false, k == 1);
+        if (model.nfaces() == 0)
+            return 1;
+
+        mygl::Framebuffer fb(size, size);
+        TexturedShader shader;
+        shader.model = &model;
+        shader.mesh  = &model.lod(0);
+        double ms = 0;
+        for (int r = 0; r < reps; r ++)
+        {
+            for (int v = 0; v < views; v ++)
+            {
+                float angle = 2.f * M_PI * v / views;
+                Vec3f eye(3.f * std::sin(angle), 1.f, 3.f * std::cos(angle));
+                mygl::View view;
+                mygl::viewMatrix(view, eye, Vec3f(0, 0, 0), Vec3f(0, 1, 0));
+                mygl::viewportMatrix(view, size / 8, size / 8, size * 3 / 4, size * 3 / 4);
+                mygl::projectionMatrix(view, -1.f / eye.norm());
+                shader.transform = view.transform();
+
+                fb.clear();
+                auto start = Clock::now();
+                for (int i = 0; i < model.nfaces(); i ++)
+                {
+                    Vec4f pts[3];
+                    for (int j = 0; j < 3; j ++)
+                        pts[j] = shader.vertex(i, j);
+                    mygl::triangle(pts, shader, fb);
+                }
+                ms += elapsedMs(start);
+            }
+        }
+        int nverts = int(model.vertices().size());
+        std::printf("%-11s %8.3f %8d %12.3f %14ld\n", names[k], meshopt::acmr(model.indices(), nverts), nverts,
+                    ms / (views * reps), shader.shaded / (views * reps));
+    }
+    return 0;
+}
+
+// 各级 LOD 的三角形数和误差, 以及模型在屏幕上不同大小时选中的 LOD 和绘制耗时
+int bench::lodSelection(const char *filename)
+{
+    Model model(filename);
+    if (model.nfaces() == 0)
+        return 1;
+
+    std::printf("%-5s %8s %10s\n", "lod", "faces", "error");
+    for (int i = 0; i < model.nlods(); i ++)
+        std::printf("%-5d %8d %10.5f\n", i, model.lod(i).nfaces(), model.lod(i).error);
+
+    const int size = 800;
+    mygl::Framebuffer fb(size, size);
+    TexturedShader shader;
+    shader.model = &model;
+
+    // 正交地把模型缩放到指定的屏幕半径, 放在屏幕中央
+    std::printf("\n%-12s %5s %8s %12s %14s %12s\n", "radius (px)", "lod", "faces", "ms / draw", "ms / draw lod0", "frags");
+    for (float radius_px = 400.f; radius_px >= 1.f; radius_px /= 4.f)
+    {
+        float ppu = radius_px / model.radius();
+        Matrix4f m = Matrix4f::identity();
+        for (int i = 0; i < 3; i ++)
+        {
+            m[i][i] = ppu;
+            m[i][3] = -model.center()[i] * ppu + (i < 2 ? size / 2.f : 128.f);
+        }
+        shader.transform = m;
+
+        int level = model.select_lod(ppu);
+        double ms[2];
+        long frags = 0;
+        for (int k = 0; k < 2; k ++)
+        {
+            shader.mesh = &model.lod(k == 0 ? level : 0);
+            const int reps = 20;
+            auto start = Clock::now();
+            for (int r = 0; r < reps; r ++)
+            {
+                fb.clear();
+                shader.shaded = 0;
+                for (int i = 0; i < shader.mesh->nfaces(); i ++)
+                {
+                    Vec4f pts[3];
+                    for (int j = 0; j < 3; j ++)
+                        pts[j] = shader.vertex(i, j);
+                    mygl::triangle(pts, shader, fb);
+                }
+            }
+            ms[k] = elapsedMs(start) / reps;
+            if (k == 0)
+                frags = shader.shaded;
+        }
+        std::printf("%-12.1f %5d %8d %12.4f %14.4f %12ld\n", radius_px, level, model.lod(level).nfaces(), ms[0], ms[1], frags);
+    }
+    return 0;
+}
+
+// 逐个加载 (每个资源等上一个完成) 与同时提交给线程池的冷启动耗时, 以及各资源单独的耗时
+int bench::assetLoading(const char *filename)
+{
+    MaterialPaths paths = resolve_material(filename);
+    double each[4];
+    double serial = 0;
+    {
+        AssetManager assets;
+        auto start = Clock::now();
+        assets.mesh(filename, false).get();
+        each[0] = elapsedMs(start);
+        assets.texture(paths.diffuse, Texture::LINEAR).get();
+        each[1] = elapsedMs(start) - each[0];
+        assets.texture(paths.specular, Texture::LINEAR).get();
+        each[2] = elapsedMs(start) - each[0] - each[1];
+        assets.texture(paths.normal, Texture::LINEAR, Texture::UNCOMPRESSED, memstats::NORMAL_MAP).get();
+        serial = elapsedMs(start);
+        each[3] = serial - each[0] - each[1] - each[2];
+    }
+    double concurrent = 0;
+    {
+        AssetManager assets;
+        auto start = Clock::now();
+        auto mesh     = assets.mesh(filename, false);
+        auto diffuse  = assets.texture(paths.diffuse, Texture::LINEAR);
+        auto specular = assets.texture(paths.specular, Texture::LINEAR);
+        auto normal   = assets.texture(paths.normal, Texture::LINEAR, Texture::UNCOMPRESSED, memstats::NORMAL_MAP);
+        mesh.get();
+        diffuse.get();
+        specular.get();
+        normal.get();
+        concurrent = elapsedMs(start);
+    }
+    std::printf("mesh %.1f ms, diffuse %.1f ms, specular %.1f ms, normal %.1f ms\n", each[0], each[1], each[2], each[3]);
+    std::printf("serial %.1f ms, concurrent %.1f ms (%u hardware threads)\n", serial, concurrent,
+                std::thread::hardware_concurrency());
+    return 0;
+}
+
+namespace
+{
+// 顶点已经在屏幕空间 (w = 1), 片段只插值两个 varying 并写常量颜色, 耗时主要在光栅化本身
+class FlatShader : public mygl::IShader
+{
+public:
+    const std::vector<Vec4f> *pts;
+    long fragments = 0;
+
+    Vec4f vertex(int iface, int nthvert) override
+    {
+        const Vec4f &p = (*pts)[iface * 3 + nthvert];
+        nvaryings = 2;
+        varying[nthvert][0] = p[0] / 800.f;
+        varying[nthvert][1] = p[1] / 800.f;
+        return p;
+    }
+
+    bool fragment(const mygl::Fragment &frag, TGAColor &color) override
+    {
+        fragments ++;
+        color = TGAColor((unsigned char)(frag.varying[0] * 255), (unsigned char)(frag.varying[1] * 255), 128);
+        return false;
+    }
+};
+
+void addTriangle(std::vector<Vec4f> &pts, float x0, float y0, float x1, float y1, float x2, float y2)
+{
+    pts.push_back(embed<4>(Vec3f(x0, y0, 100.f), 1.f));
+    pts.push_back(embed<4>(Vec3f(x1, y1, 100.f), 1.f));
+    pts.push_back(embed<4>(Vec3f(x2, y2, 100.f), 1.f));
+}
+}
+
+// 大三角形, 细长三角形和小三角形三种情况下光栅化的耗时和每个片段的平均耗时
+int bench::rasterBlocks()
+{
+    const int size = 800;
+    const int reps = 20;
+    const char *names[] = {"large", "sliver", "small"};
+    std::vector<Vec4f> scenes[3];
+    // 两个三角形铺满整个帧缓冲
+    addTriangle(scenes[0], 0, 0, size, 0, 0, size);
+    addTriangle(scenes[0], size, 0, size, size, 0, size);
+    // 斜跨屏幕, 宽约两个像素, 包围盒很大但覆盖很少
+    for (int i = 0; i < 200; i ++)
+        addTriangle(scenes[1], 5.f, 5.f + 2 * i, size - 5.f, 390.f + 2 * i, size - 5.f, 392.f + 2 * i);
+    // 8x8 像素的网格, 每格两个三角形
+    for (int y = 0; y < size; y += 8)
+        for (int x = 0; x < size; x += 8)
+        {
+            addTriangle(scenes[2], x, y, x + 8, y, x, y + 8);
+            addTriangle(scenes[2], x + 8, y, x + 8, y + 8, x, y + 8);
+        }
+
+    mygl::Framebuffer fb(size, size);
+    std::printf("%-8s %10s %12s %12s\n", "scene", "faces", "ms / frame", "ns / frag");
+    for (int s = 0; s < 3; s ++)
+    {
+        FlatShader shader;
+        shader.pts = &scenes[s];
+        int nfaces = int(scenes[s].size() / 3);
+        double ms = 0;
+        for (int r = 0; r < reps; r ++)
+        {
+            fb.clear();
+            auto start = Clock::now();
+            for (int i = 0; i < nfaces; i ++)
+            {
+                Vec4f pts[3];
+                for (int j = 0; j < 3; j ++)
+                    pts[j] = shader.vertex(i, j);
+                mygl::triangle(pts, shader, fb);
+            }
+            ms += elapsedMs(start);
+        }
+        std::printf("%-8s %10d %12.3f %12.2f\n", names[s], nfaces, ms / reps, ms * 1e6 / shader.fragments);
+    }
+    return 0;
+}
+
+namespace
+{
+// 统计片段着色次数
+class CountingShader : public GouraudShader
+{
+public:
+    long shaded = 0;
+
+    bool fragment(const mygl::Fragment &frag, TGAColor &color) override
+    {
+        shaded ++;
+        return GouraudShader::fragment(frag, color);
+    }
+};
+
+double imagePsnr(const Image<RGB8> &ref, const Image<RGB8> &img)
+{
+    double err = 0;
+    for (size_t i = 0; i < ref.bytes(); i ++)
+    {
+        double d = double(ref.buffer()[i]) - img.buffer()[i];
+        err += d * d;
+    }
+    err /= double(ref.bytes());
+    return err == 0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / err);
+}
+}
+
+// 不抗锯齿, 4x MSAA 和 4x SSAA (两倍分辨率渲染后 box 缩小) 的帧耗时, 片段着色次数, 以及与 SSAA 相比的 PSNR
+int bench::antialiasing(const char *filename)
+{
+    Model model(filename);
+    if (model.nfaces() == 0)
+        return 1;
+    model.prepare_view_normals(normalMatrix());
+
+    const int size = 800;
+    const int reps = 5;
+    const char *names[] = {"1x", "msaa 4x", "ssaa 4x"};
+    Image<RGB8> images[3];
+    double ms[3];
+    long shaded[3];
+    for (int mode = 0; mode < 3; mode ++)
+    {
+        int scale = mode == 2 ? 2 : 1;
+        int samples = mode == 1 ? mygl::Framebuffer::MAX_SAMPLES : 1;
+        mygl::View view = cameraView(Camera(), size * scale, size * scale);
+        if (scale == 2)
+        {
+            // 高分辨率的 2x2 个像素中心以低分辨率的像素中心为中心
+            view.viewport[0][3] += 0.5f;
+            view.viewport[1][3] += 0.5f;
+        }
+        mygl::Framebuffer fb(size * scale, size * scale, mygl::Framebuffer::TILED, samples);
+        Image<RGB8> color(size * scale, size * scale);
+        Image<Gray8> depth(size * scale, size * scale);
+        CountingShader shader;
+        shader.setup(view, DEFAULT_LIGHT);
+
+        auto start = Clock::now();
+        for (int r = 0; r < reps; r ++)
+        {
+            fb.clear();
+            shader.shaded = 0;
+            drawInstance(shader, view, model, Matrix4f::identity(), model.center(), 1.f, fb);
+            fb.resolve(color, depth);
+            images[mode] = Image<RGB8>(size, size);
+            imageops::resample(color, images[mode]);
+        }
+        ms[mode] = elapsedMs(start) / reps;
+        shaded[mode] = shader.shaded;
+    }
+
+    std::printf("%-8s %12s %12s %14s\n", "mode", "ms / frame", "shaded", "psnr vs ssaa");
+    for (int mode = 0; mode < 3; mode ++)
+        std::printf("%-8s %12.3f %12ld %14.2f\n", names[mode], ms[mode], shaded[mode], imagePsnr(images[2], images[mode]));
+    return 0;
+}
+
+// 整帧着色率 1, 2, 4 以及按 1x 图像自适应选择各分块着色率时的帧耗时, 片段着色次数和与 1x 相比的 PSNR
+int bench::shadingRates(const char *filename, float threshold)
+{
+    Model model(filename);
+    if (model.nfaces() == 0)
+        return 1;
+    model.prepare_view_normals(normalMatrix());
+
+    const int size = 800;
+    const int reps = 5;
+    mygl::View view = cameraView(Camera(), size, size);
+    mygl::Framebuffer fb(size, size);
+    Image<RGB8> reference(size, size), color(size, size);
+    Image<Gray8> depth(size, size);
+
+    std::printf("%-10s %12s %12s %10s %12s\n", "rate", "ms / frame", "shaded", "psnr", "tiles 1/2/4");
+    for (int mode = 0; mode < 4; mode ++)
+    {
+        bool adaptive = mode == 3;
+        CountingShader shader;
+        shader.setup(view, DEFAULT_LIGHT);
+        shader.shading_rate = adaptive ? 1 : 1 << mode;
+        if (adaptive)
+            fb.adapt_shading_rates(reference, threshold);
+        else
+            fb.set_shading_rates(1);
+
+        auto start = Clock::now();
+        for (int r = 0; r < reps; r ++)
+        {
+            fb.clear();
+            shader.shaded = 0;
+            drawInstance(shader, view, model, Matrix4f::identity(), model.center(), 1.f, fb);
+        }
+        double ms = elapsedMs(start) / reps;
+        fb.resolve(mode == 0 ? reference : color, depth);
+
+        int tiles[5] = {0};
+        for (int ty = 0; ty < fb.tiles_y(); ty ++)
+            for (int tx = 0; tx < fb.tiles_x(); tx ++)
+                tiles[std::max(shader.shading_rate, fb.shading_rate(tx * mygl::Framebuffer::TILE,
+                                                                    ty * mygl::Framebuffer::TILE))] ++;
+        char name[32], split[32];
+        std::snprintf(name, sizeof(name), adaptive ? "adaptive" : "%dx%d", 1 << mode, 1 << mode);
+        std::snprintf(split, sizeof(split), "%d/%d/%d", tiles[1], tiles[2], tiles[4]);
+        std::printf("%-10s %12.3f %12ld %10.2f %12s\n", name, ms, shader.shaded,
+                    mode == 0 ? 99.0 : imagePsnr(reference, color), split);
+    }
+    return 0;
+}
+
+// 流水线不写文件, 先按相同的相机位姿转一圈预热 (三角形缓冲, 任务池等达到最大用量), 再数第二圈的堆分配.
+// 增量重画时前两个实例一直在转
+int bench::allocations(const char *filename)
+{
+    Scene scene;
+    int head = scene.add_model(std::make_shared<Model>(filename));
+    if (scene.model(head).nfaces() == 0)
+        return 1;
+    scene.model(head).prepare_view_normals(normalMatrix());
+    const int side = 4;
+    float spacing = 2.5f * scene.model(head).radius() * 0.15f;
+    for (int i = 0; i < side * side; i ++)
+    {
+        Matrix4f m = Matrix4f::identity();
+        for (int k = 0; k < 3; k ++)
+            m[k][k] = 0.15f;
+        m[0][3] = (i % side - (side - 1) * 0.5f) * spacing;
+        m[1][3] = (i / side - (side - 1) * 0.5f) * spacing;
+        scene.add_instance(head, m);
+    }
+    scene.build();
+    std::vector<Matrix4f> rest = {scene.instance(0).transform, scene.instance(1).transform};
+
+    const int size = 800;
+    const int frames = 24;
+    const std::string none;
+    const char *names[] = {"default", "msaa", "incremental"};
+    std::printf("%-12s %8s %14s %14s %12s\n", "mode", "frames", "allocs/frame", "bytes/frame", "arena KB");
+    for (int mode = 0; mode < 3; mode ++)
+    {
+        mygl::Scheduler scheduler;
+        FramePipeline pipeline(scene, size, size, 3, scheduler, mode == 1 ? 4 : 1);
+        pipeline.set_incremental(mode == 2);
+
+        mygl::HeapCounters before{};
+        for (int pass = 0; pass < 2; pass ++)
+        {
+            if (pass == 1)
+                before = mygl::heapCounters();
+            for (int f = 0; f < frames; f ++)
+            {
+                Camera camera = turntable(Camera(), f, frames);
+                if (mode == 2)
+                {
+                    float angle = 2.f * M_PI * f / frames;
+                    Matrix4f spin = Matrix4f::identity();
+                    spin[0][0] = spin[2][2] = std::cos(angle);
+                    spin[0][2] = std::sin(angle);
+                    spin[2][0] = -std::sin(angle);
+                    for (int i = 0; i < 2; i ++)
+                        scene.set_transform(i, rest[i] * spin);
+                    scene.refit();
+                    camera = Camera();
+                }
+                pipeline.submit(camera, none, none);
+            }
+            pipeline.flush();
+        }
+        mygl::HeapCounters after = mygl::heapCounters();
+        std::printf("%-12s %8d %14.2f %14.1f %12zu\n", names[mode], frames,
+                    double(after.allocations - before.allocations) / frames,
+                    double(after.bytes - before.bytes) / frames, pipeline.arena_capacity() / 1024);
+    }
+    return 0;
+}
+
+int bench::run(int argc, char **argv)
+{
+    const char *name = argc > 0 ? argv[0] : "";
+    if (!std::strcmp(name, "texture"))
+        return textureLayouts(argc > 1 ? argv[1] : "../data/african_head_diffuse.tga");
+
+    if (!std::strcmp(name, "compressed"))
+        return compressedTextures(argc > 1 ? argv[1] : "../data/african_head.obj");
+
+    if (!std::strcmp(name, "fastmath"))
+        return fastMath();
+
+    if (!std::strcmp(name, "lod"))
+        return lodSelection(argc > 1 ? argv[1] : "../data/african_head.obj");
+
+    if (!std::strcmp(name, "assets"))
+        return assetLoading(argc > 1 ? argv[1] : "../data/african_head.obj");
+
+    if (!std::strcmp(name, "mesh"))
+        return meshOrder(argc > 1 ? argv[1] : "../data/african_head.obj");
+
+    if (!std::strcmp(name, "raster"))
+        return rasterBlocks();
+
+    if (!std::strcmp(name, "vrs"))
+        return shadingRates(argc > 1 ? argv[1] : "../data/african_head.obj", argc > 2 ? std::atof(argv[2]) : 4.f);
+
+    if (!std::strcmp(name, "alloc"))
+        return allocations(argc > 1 ? argv[1] : "../data/african_head.obj");
+
+    if (!std::strcmp(name, "aa"))
+        return antialiasing(argc > 1 ? argv[1] : "../data/african_head.obj");
+
+    std::fprintf(stderr, "usage: tinyRenderer --bench texture [file.tga]\n"
+                         "       tinyRenderer --bench fastmath\n"
+                         "       tinyRenderer --bench raster\n"
+                         "       tinyRenderer --bench aa [model.obj]\n"
+                         "       tinyRenderer --bench vrs [model.obj] [threshold]\n"
+                         "       tinyRenderer --bench alloc [model.obj]\n"
+                         "       tinyRenderer --bench mesh [model.obj]\n"
+                         "       tinyRenderer --bench lod [model.obj]\n"
+                         "       tinyRenderer --bench assets [model.obj]\n"
+                         "       tinyRenderer --bench compressed [model.obj]\n");
+    return 1;
+}
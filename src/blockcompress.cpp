@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cmath>
+#include "blockcompress.h"
+
+static uint16_t to565(float r, float g, float b)
+{
+    int ir = std::max(0, std::min(31, int(r * 31.f / 255.f + .5f)));
+    int ig = std::max(0, std::min(63, int(g * 63.f / 255.f + .5f)));
+    int ib = std::max(0, std::min(31, int(b * 31.f / 255.f + .5f)));
+    return uint16_t((ir << 11) | (ig << 5) | ib);
+}
+
+// 端点取纹素在主轴方向上投影的两端, 主轴用幂迭代求协方差矩阵的最大特征向量
+void blockcompress::encode_bc1(const TGAColor texels[16], unsigned char out[8])
+{
+    float mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i ++)
+    {
+        mean[0] += texels[i].r;
+        mean[1] += texels[i].g;
+        mean[2] += texels[i].b;
+    }
+    for (int k = 0; k < 3; k ++)
+        mean[k] /= 16.f;
+
+    float cov[6] = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 16; i ++)
+    {
+        float d[3] = {texels[i].r - mean[0], texels[i].g - mean[1], texels[i].b - mean[2]};
+        cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+    }
+
+    float axis[3] = {1, 1, 1};
+    for (int it = 0; it < 8; it ++)
+    {
+        float v[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                      cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                      cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+        float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (len < 1e-6f)
+            break;
+        for (int k = 0; k < 3; k ++)
+            axis[k] = v[k] / len;
+    }
+
+    float tmin = 1e9f, tmax = -1e9f;
+    for (int i = 0; i < 16; i ++)
+    {
+        float t = (texels[i].r - mean[0]) * axis[0] + (texels[i].g - mean[1]) * axis[1] + (texels[i].b - mean[2]) * axis[2];
+        tmin = std::min(tmin, t);
+        tmax = std::max(tmax, t);
+    }
+
+    uint16_t c0 = to565(mean[0] + axis[0] * tmax, mean[1] + axis[1] * tmax, mean[2] + axis[2] * tmax);
+    uint16_t c1 = to565(mean[0] + axis[0] * tmin, mean[1] + axis[1] * tmin, mean[2] + axis[2] * tmin);
+    // c0 > c1 选择四色模式
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    out[0] = c0 & 0xff; out[1] = c0 >> 8;
+    out[2] = c1 & 0xff; out[3] = c1 >> 8;
+    memset(out + 4, 0, 4);
+    if (c0 == c1)
+        return;
+
+    TGAColor palette[4];
+    for (int k = 0; k < 4; k ++)
+    {
+        unsigned char probe[8] = {out[0], out[1], out[2], out[3], (unsigned char)(k * 0x55), 0, 0, 0};
+        palette[k] = decode_bc1(probe, 0);
+    }
+    for (int i = 0; i < 16; i ++)
+    {
+        int best = 0, bestd = 1 << 30;
+        for (int k = 0; k < 4; k ++)
+        {
+            int dr = texels[i].r - palette[k].r, dg = texels[i].g - palette[k].g, db = texels[i].b - palette[k].b;
+            int d = dr * dr + dg * dg + db * db;
+            if (d < bestd)
+            {
+                bestd = d;
+                best = k;
+            }
+        }
+        out[4 + (i >> 2)] |= best << ((i & 3) * 2);
+    }
+}
+
+// 端点取最大/最小值, 使用8级插值模式
+void blockcompress::encode_bc4(const unsigned char values[16], unsigned char out[8])
+{
+    unsigned char lo = 255, hi = 0;
+    for (int i = 0; i < 16; i ++)
+    {
+        lo = std::min(lo, values[i]);
+        hi = std::max(hi, values[i]);
+    }
+    out[0] = hi;
+    out[1] = lo;
+    memset(out + 2, 0, 6);
+    if (hi == lo)
+        return;
+
+    unsigned char palette[8];
+    for (int k = 0; k < 8; k ++)
+    {
+        unsigned char probe[8] = {hi, lo, (unsigned char)k, 0, 0, 0, 0, 0};
+        palette[k] = decode_bc4(probe, 0);
+    }
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; i ++)
+    {
+        int best = 0, bestd = 256;
+        for (int k = 0; k < 8; k ++)
+        {
+            int d = std::abs(int(values[i]) - int(palette[k]));
+            if (d < bestd)
+            {
+                bestd = d;
+                best = k;
+            }
+        }
+        bits |= uint64_t(best) << (3 * i);
+    }
+    memcpy(out + 2, &bits, 6);
+}
+
+void blockcompress::encode_bc5(const unsigned char x[16], const unsigned char y[16], unsigned char out[16])
+{
+    encode_bc4(x, out);
+    encode_bc4(y, out + 8);
+}
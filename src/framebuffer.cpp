@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "framebuffer.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+mygl::Framebuffer::Framebuffer() : width_(0), height_(0), tiles_x_(0), layout_(LINEAR), samples_(1)
+{
+}
+
+mygl::Framebuffer::Framebuffer(int w, int h, Layout layout, int samples)
+    : width_(w), height_(h), tiles_x_((w + TILE - 1) / TILE), layout_(layout),
+      samples_(samples == MAX_SAMPLES ? MAX_SAMPLES : 1)
+{
+    int pw = w, ph = h;
+    if (layout_ == TILED)
+    {
+        pw = tiles_x_ * TILE;
+        ph = (h + TILE - 1) / TILE * TILE;
+    }
+    rates_.assign(size_t(tiles_x_) * tiles_y(), 1);
+    color_ = Image<RGB8>(pw, ph);
+    depth_ = Image<Gray8>(pw * samples_, ph);
+    if (samples_ > 1)
+    {
+        extra_.assign(samples_ - 1, Image<RGB8>(pw, ph));
+        full_ = Image<Gray8>(pw, ph);
+        memset(full_.buffer(), 1, full_.bytes());
+    }
+    color_memory_.set(color_.bytes() * samples_ + full_.bytes() + rates_.size());
+    depth_memory_.set(depth_.bytes());
+}
+
+size_t mygl::Framebuffer::bytes(int w, int h, Layout layout, int samples)
+{
+    size_t tiles_x = (w + TILE - 1) / TILE, tiles_y = (h + TILE - 1) / TILE;
+    size_t pixels = layout == TILED ? tiles_x * TILE * tiles_y * TILE : size_t(w) * h;
+    size_t n = samples == MAX_SAMPLES ? MAX_SAMPLES : 1;
+    return pixels * RGB8::bytespp * n + (n > 1 ? pixels : 0) + tiles_x * tiles_y + pixels * n;
+}
+
+void mygl::Framebuffer::clear()
+{
+    color_.clear();
+    depth_.clear();
+    // 清屏后每个像素都是整像素, 其余采样点平面里的旧值不会再被读到
+    if (samples_ > 1)
+        memset(full_.buffer(), 1, full_.bytes());
+}
+
+void mygl::Framebuffer::clear_tile(int tx, int ty)
+{
+    // 分块布局下一个分块是连续的一段, 行线性布局下逐行清空
+    const int n = layout_ == TILED ? 1 : std::min(TILE, height_ - ty * TILE);
+    const int run = layout_ == TILED ? TILE * TILE : std::min(TILE, width_ - tx * TILE);
+    for (int r = 0; r < n; r ++)
+    {
+        size_t i = index(tx * TILE, ty * TILE + r);
+        memset(color_.buffer() + i * RGB8::bytespp, 0, size_t(run) * RGB8::bytespp);
+        memset(depth_.buffer() + i * samples_, 0, size_t(run) * samples_);
+        if (samples_ > 1)
+            memset(full_.buffer() + i, 1, run);
+    }
+}
+
+void mygl::Framebuffer::set_shading_rates(int rate)
+{
+    std::fill(rates_.begin(), rates_.end(), (unsigned char)rate);
+}
+
+void mygl::Framebuffer::adapt_shading_rates(const Image<RGB8> &previous, float threshold)
+{
+    auto luma = [&previous](int x, int y)
+    {
+        const unsigned char *p = previous.pixel(x, y);
+        // BGR
+        return (p[0] * 29 + p[1] * 150 + p[2] * 77) >> 8;
+    };
+    for (int ty = 0; ty < tiles_y(); ty ++)
+    {
+        for (int tx = 0; tx < tiles_x_; tx ++)
+        {
+            int x0 = tx * TILE, x1 = std::min(x0 + TILE, width_) - 1;
+            int y0 = ty * TILE, y1 = std::min(y0 + TILE, height_) - 1;
+            long sum = 0, n = 0;
+            for (int y = y0; y <= y1; y ++)
+            {
+                for (int x = x0; x <= x1; x ++)
+                {
+                    int l = luma(x, y);
+                    if (x < x1)
+                    {
+                        sum += std::abs(luma(x + 1, y) - l);
+                        n ++;
+                    }
+                    if (y < y1)
+                    {
+                        sum += std::abs(luma(x, y + 1) - l);
+                        n ++;
+                    }
+                }
+            }
+            float contrast = n ? float(sum) / n : 0.f;
+            set_shading_rate(tx, ty, contrast < threshold / 4 ? 4 : contrast < threshold ? 2 : 1);
+        }
+    }
+}
+
+// 分块布局下每个分块的一行在两边都是连续的, 按分块行整段拷贝
+template <class Format>
+static void resolveTiles(const unsigned char *src, Image<Format> &dst, int width, int height, int tiles_x)
+{
+    const int bpp  = Format::bytespp;
+    const int tile = mygl::Framebuffer::TILE;
+    for (int y = 0; y < height; y ++)
+    {
+        unsigned char *out = dst.buffer() + size_t(y) * width * bpp;
+        for (int tx = 0; tx < tiles_x; tx ++)
+        {
+            int x0 = tx * tile;
+            int n  = std::min(tile, width - x0);
+            const unsigned char *in = src + tiled_index<mygl::Framebuffer::TILE>(x0, y, tiles_x) * bpp;
+            memcpy(out + x0 * bpp, in, size_t(n) * bpp);
+        }
+    }
+}
+
+// 4 个采样点的颜色平均, 整像素直接取颜色缓冲中的值
+static void resolveColorSamples(unsigned char *out, const unsigned char *in[4], const unsigned char *full, int n)
+{
+    const int bpp = RGB8::bytespp;
+    // 全是整像素时 (三角形内部和背景) 只拷贝颜色缓冲
+    if (!memchr(full, 0, n))
+    {
+        memcpy(out, in[0], size_t(n) * bpp);
+        return;
+    }
+    int i = 0;
+#if defined(__SSE2__)
+    // 每次 16 字节, 各通道扩展到 16 位求和, 整像素最后按标记覆盖回去
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n * bpp; i += 16)
+    {
+        __m128i lo = _mm_set1_epi16(2), hi = lo;
+        for (int s = 0; s < 4; s ++)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(in[s] + i));
+            lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+            hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+        }
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2)));
+    }
+#endif
+    for (; i < n * bpp; i ++)
+        out[i] = (unsigned char)((in[0][i] + in[1][i] + in[2][i] + in[3][i] + 2) >> 2);
+    for (int x = 0; x < n; x ++)
+        if (full[x])
+            memcpy(out + x * bpp, in[0] + x * bpp, bpp);
+}
+
+// 每像素 4 个采样点的深度取最大值
+static void resolveDepthSamples(unsigned char *out, const unsigned char *in, int n)
+{
+    int x = 0;
+#if defined(__SSE2__)
+    // 每次 4 个像素: 在每个 32 位通道内求 4 个字节的最大值, 再压缩成 4 个字节
+    const __m128i low = _mm_set1_epi32(0xff);
+    for (; x + 4 <= n; x += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + x * 4));
+        v = _mm_max_epu8(v, _mm_srli_epi32(v, 8));
+        v = _mm_max_epu8(v, _mm_srli_epi32(v, 16));
+        v = _mm_and_si128(v, low);
+        v = _mm_packs_epi32(v, v);
+        v = _mm_packus_epi16(v, v);
+        int packed = _mm_cvtsi128_si32(v);
+        memcpy(out + x, &packed, 4);
+    }
+#endif
+    for (; x < n; x ++)
+        out[x] = std::max(std::max(in[x * 4], in[x * 4 + 1]), std::max(in[x * 4 + 2], in[x * 4 + 3]));
+}
+
+void mygl::Framebuffer::resolveSamples(Image<RGB8> &color, Image<Gray8> &depth) const
+{
+    // 分块布局下按分块的一行处理, 行线性布局下一次处理一整行
+    const int run = layout_ == TILED ? TILE : width_;
+    for (int y = 0; y < height_; y ++)
+    {
+        for (int x0 = 0; x0 < width_; x0 += run)
+        {
+            int n = std::min(run, width_ - x0);
+            size_t i = index(x0, y);
+            const unsigned char *in[4] = {color_.buffer() + i * RGB8::bytespp, extra_[0].buffer() + i * RGB8::bytespp,
+                                          extra_[1].buffer() + i * RGB8::bytespp,
+                                          extra_[2].buffer() + i * RGB8::bytespp};
+            resolveColorSamples(color.pixel(x0, y), in, full_.buffer() + i, n);
+            resolveDepthSamples(depth.pixel(x0, y), depth_.buffer() + i * samples_, n);
+        }
+    }
+}
+
+void mygl::Framebuffer::resolve(Image<RGB8> &color, Image<Gray8> &depth) const
+{
+    if (samples_ > 1)
+    {
+        resolveSamples(color, depth);
+        return;
+    }
+    if (layout_ == LINEAR)
+    {
+        memcpy(color.buffer(), color_.buffer(), color_.bytes());
+        memcpy(depth.buffer(), depth_.buffer(), depth_.bytes());
+        return;
+    }
+    resolveTiles(color_.buffer(), color, width_, height_, tiles_x_);
+    resolveTiles(depth_.buffer(), depth, width_, height_, tiles_x_);
+}
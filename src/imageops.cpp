@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "arena.h"
+#include "imageops.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 16字节内按字节逆序
+#if defined(__SSE2__)
+static inline __m128i reverse_bytes(__m128i v)
+{
+    v = _mm_shuffle_epi32(v, 0x1B);
+    v = _mm_shufflelo_epi16(v, 0xB1);
+    v = _mm_shufflehi_epi16(v, 0xB1);
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+#endif
+
+// 用颜色填满一行, 每行单独填充后直接拷贝即可
+static void fill_row(unsigned char *row, int w, int bpp, TGAColor c)
+{
+    int i = 0;
+    if (bpp == 1)
+    {
+        memset(row, c.raw[0], w);
+        return;
+    }
+#if defined(__SSE2__)
+    if (bpp == 4)
+    {
+        __m128i v = _mm_set1_epi32(int(c.val));
+        for (; i + 4 <= w; i += 4)
+            _mm_storeu_si128((__m128i *)(row + i * 4), v);
+    }
+    else if (bpp == 3)
+    {
+        // 16个像素正好是3个向量
+        unsigned char pattern[48];
+        for (int k = 0; k < 16; k ++)
+            memcpy(pattern + k * 3, c.raw, 3);
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(pattern));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(pattern + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(pattern + 32));
+        for (; i + 16 <= w; i += 16)
+        {
+            unsigned char *p = row + i * 3;
+            _mm_storeu_si128((__m128i *)(p), v0);
+            _mm_storeu_si128((__m128i *)(p + 16), v1);
+            _mm_storeu_si128((__m128i *)(p + 32), v2);
+        }
+    }
+#endif
+    for (; i < w; i ++)
+        memcpy(row + i * bpp, c.raw, bpp);
+}
+
+void imageops::fill_bytes(unsigned char *data, int w, int h, int bpp, TGAColor c)
+{
+    if (!data || w <= 0 || h <= 0)
+        return;
+    size_t line = size_t(w) * bpp;
+    fill_row(data, w, bpp, c);
+    for (int y = 1; y < h; y ++)
+        memcpy(data + y * line, data, line);
+}
+
+template <int BPP>
+static void flip_row(unsigned char *row, int w)
+{
+    int l = 0;
+    int r = w;
+#if defined(__SSE2__)
+    if (BPP == 4)
+    {
+        for (; r - l >= 8; l += 4, r -= 4)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(row + l * 4));
+            __m128i b = _mm_loadu_si128((const __m128i *)(row + (r - 4) * 4));
+            _mm_storeu_si128((__m128i *)(row + l * 4), _mm_shuffle_epi32(b, 0x1B));
+            _mm_storeu_si128((__m128i *)(row + (r - 4) * 4), _mm_shuffle_epi32(a, 0x1B));
+        }
+    }
+    else if (BPP == 1)
+    {
+        for (; r - l >= 32; l += 16, r -= 16)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(row + l));
+            __m128i b = _mm_loadu_si128((const __m128i *)(row + r - 16));
+            _mm_storeu_si128((__m128i *)(row + l), reverse_bytes(b));
+            _mm_storeu_si128((__m128i *)(row + r - 16), reverse_bytes(a));
+        }
+    }
+#endif
+    for (; l < r - 1; l ++, r --)
+    {
+        unsigned char tmp[BPP];
+        memcpy(tmp, row + l * BPP, BPP);
+        memcpy(row + l * BPP, row + (r - 1) * BPP, BPP);
+        memcpy(row + (r - 1) * BPP, tmp, BPP);
+    }
+}
+
+void imageops::flip_bytes_horizontally(unsigned char *data, int w, int h, int bpp)
+{
+    if (!data)
+        return;
+    size_t line = size_t(w) * bpp;
+    for (int y = 0; y < h; y ++)
+    {
+        unsigned char *row = data + y * line;
+        switch (bpp)
+        {
+        case 1: flip_row<1>(row, w); break;
+        case 3: flip_row<3>(row, w); break;
+        case 4: flip_row<4>(row, w); break;
+        default: break;
+        }
+    }
+}
+
+void imageops::blit_bytes(unsigned char *dst, int dst_w, int dst_h,
+                          const unsigned char *src, int src_w, int src_h,
+                          int bpp, int dx, int dy, int sx, int sy, int w, int h)
+{
+    if (!dst || !src)
+        return;
+    // 裁剪到两张图的公共范围
+    if (dx < 0) { sx -= dx; w += dx; dx = 0; }
+    if (dy < 0) { sy -= dy; h += dy; dy = 0; }
+    if (sx < 0) { dx -= sx; w += sx; sx = 0; }
+    if (sy < 0) { dy -= sy; h += sy; sy = 0; }
+    w = std::min(w, std::min(dst_w - dx, src_w - sx));
+    h = std::min(h, std::min(dst_h - dy, src_h - sy));
+    if (w <= 0 || h <= 0)
+        return;
+
+    size_t nbytes = size_t(w) * bpp;
+    for (int y = 0; y < h; y ++)
+        memmove(dst + (size_t(dy + y) * dst_w + dx) * bpp,
+                src + (size_t(sy + y) * src_w + sx) * bpp, nbytes);
+}
+
+// 把一行字节累加到16位累加器上
+static void accumulate_row(uint16_t *acc, const unsigned char *row, size_t n)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v  = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i lo = _mm_loadu_si128((const __m128i *)(acc + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(acc + i + 8));
+        lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+        hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+        _mm_storeu_si128((__m128i *)(acc + i), lo);
+        _mm_storeu_si128((__m128i *)(acc + i + 8), hi);
+    }
+#endif
+    for (; i < n; i ++)
+        acc[i] += row[i];
+}
+
+void imageops::downsample_box_bytes(const unsigned char *src, int sw, int sh,
+                                    unsigned char *dst, int factor, int bpp)
+{
+    if (!src || !dst || factor < 1)
+        return;
+    int dw = sw / factor;
+    int dh = sh / factor;
+    size_t sline = size_t(sw) * bpp;
+    uint32_t area = uint32_t(factor) * factor;
+
+    // 16位累加器最多容纳 256 个样本
+    if (area <= 256)
+    {
+        std::vector<uint16_t> acc(sline);
+        for (int y = 0; y < dh; y ++)
+        {
+            std::fill(acc.begin(), acc.end(), 0);
+            for (int k = 0; k < factor; k ++)
+                accumulate_row(acc.data(), src + (size_t(y) * factor + k) * sline, sline);
+
+            unsigned char *out = dst + size_t(y) * dw * bpp;
+            for (int x = 0; x < dw; x ++)
+            {
+                for (int c = 0; c < bpp; c ++)
+                {
+                    uint32_t sum = 0;
+                    for (int k = 0; k < factor; k ++)
+                        sum += acc[(size_t(x) * factor + k) * bpp + c];
+                    out[x * bpp + c] = (unsigned char)((sum + area / 2) / area);
+                }
+            }
+        }
+        return;
+    }
+
+    for (int y = 0; y < dh; y ++)
+    {
+        for (int x = 0; x < dw; x ++)
+        {
+            for (int c = 0; c < bpp; c ++)
+            {
+                uint32_t sum = 0;
+                for (int j = 0; j < factor; j ++)
+                    for (int i = 0; i < factor; i ++)
+                        sum += src[(size_t(y * factor + j) * sw + x * factor + i) * bpp + c];
+                dst[(size_t(y) * dw + x) * bpp + c] = (unsigned char)((sum + area / 2) / area);
+            }
+        }
+    }
+}
+
+// 两行按 8 位定点权重做纵向插值, 结果保留 8 位小数
+static void lerp_rows(uint16_t *out, const unsigned char *r0, const unsigned char *r1, size_t n, int fy)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i w0 = _mm_set1_epi16(short(256 - fy));
+    __m128i w1 = _mm_set1_epi16(short(fy));
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(r0 + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(r1 + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1));
+        _mm_storeu_si128((__m128i *)(out + i), lo);
+        _mm_storeu_si128((__m128i *)(out + i + 8), hi);
+    }
+#endif
+    for (; i < n; i ++)
+        out[i] = uint16_t(r0[i] * (256 - fy) + r1[i] * fy);
+}
+
+void imageops::resample_bilinear_bytes(const unsigned char *src, int sw, int sh,
+                                       unsigned char *dst, int dw, int dh, int bpp)
+{
+    if (!src || !dst || sw <= 0 || sh <= 0 || dw <= 0 || dh <= 0)
+        return;
+
+    // 像素中心对齐: 目标像素中心 (x + 0.5) 映射到源图 (x + 0.5) * sw / dw - 0.5
+    // 每帧放大都会调用, 临时数组放在线程的 Arena 上
+    mygl::ArenaScope scope(mygl::threadArena());
+    int *xs  = mygl::threadArena().allocate_array<int>(dw);
+    int *fxs = mygl::threadArena().allocate_array<int>(dw);
+    for (int x = 0; x < dw; x ++)
+    {
+        float fx = std::max(0.f, (x + .5f) * sw / dw - .5f);
+        int x0 = std::min(int(fx), sw - 1);
+        xs[x]  = x0;
+        fxs[x] = (x0 + 1 < sw) ? int((fx - x0) * 256.f + .5f) : 0;
+    }
+
+    size_t sline = size_t(sw) * bpp;
+    uint16_t *row = mygl::threadArena().allocate_array<uint16_t>(sline);
+    for (int y = 0; y < dh; y ++)
+    {
+        float fy = std::max(0.f, (y + .5f) * sh / dh - .5f);
+        int y0 = std::min(int(fy), sh - 1);
+        int y1 = std::min(y0 + 1, sh - 1);
+        lerp_rows(row, src + y0 * sline, src + y1 * sline, sline, int((fy - y0) * 256.f + .5f));
+
+        unsigned char *out = dst + size_t(y) * dw * bpp;
+        for (int x = 0; x < dw; x ++)
+        {
+            const uint16_t *p0 = row + xs[x] * bpp;
+            const uint16_t *p1 = (xs[x] + 1 < sw) ? p0 + bpp : p0;
+            uint32_t w1 = fxs[x];
+            uint32_t w0 = 256 - w1;
+            for (int c = 0; c < bpp; c ++)
+                out[x * bpp + c] = (unsigned char)((p0[c] * w0 + p1[c] * w1 + 32768) >> 16);
+        }
+    }
+}
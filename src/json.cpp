@@ -0,0 +1,401 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "json.h"
+
+namespace
+{
+// 嵌套层数上限, 防止恶意输入耗尽栈
+const int MAX_DEPTH = 64;
+
+class Parser
+{
+public:
+    explicit Parser(const std::string &text) : text_(text), pos_(0) {}
+
+    bool document(json::Value &value)
+    {
+        skip();
+        if (!parse(value, 0))
+            return false;
+        skip();
+        return pos_ == text_.size() || fail("trailing characters");
+    }
+
+    std::string error() const { return error_ + " at offset " + std::to_string(pos_); }
+
+private:
+    bool fail(const char *what)
+    {
+        if (error_.empty())
+            error_ = what;
+        return false;
+    }
+
+    void skip()
+    {
+        while (pos_ < text_.size() && std::strchr(" \t\r\n", text_[pos_]))
+            pos_ ++;
+    }
+
+    bool literal(const char *word)
+    {
+        size_t n = std::strlen(word);
+        if (text_.compare(pos_, n, word))
+            return fail("invalid literal");
+        pos_ += n;
+        return true;
+    }
+
+    bool parse(json::Value &value, int depth)
+    {
+        if (depth > MAX_DEPTH)
+            return fail("nesting too deep");
+        if (pos_ >= text_.size())
+            return fail("unexpected end");
+        char c = text_[pos_];
+        switch (c)
+        {
+        case 'n':
+            value.type = json::Value::NUL;
+            return literal("null");
+        case 't':
+            value.type = json::Value::BOOL;
+            value.boolean = true;
+            return literal("true");
+        case 'f':
+            value.type = json::Value::BOOL;
+            value.boolean = false;
+            return literal("false");
+        case '"':
+            value.type = json::Value::STRING;
+            return string(value.string);
+        case '[':
+            value.type = json::Value::ARRAY;
+            return array(value, depth);
+        case '{':
+            value.type = json::Value::OBJECT;
+            return object(value, depth);
+        default:
+            value.type = json::Value::NUMBER;
+            return number(value.number);
+        }
+    }
+
+    bool number(double &result)
+    {
+        // 按 JSON 语法检查, 再交给 strtod
+        size_t start = pos_;
+        auto digits = [this]
+        {
+            size_t n = 0;
+            for (; pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9'; pos_ ++)
+                n ++;
+            return n;
+        };
+        if (pos_ < text_.size() && text_[pos_] == '-')
+            pos_ ++;
+        if (pos_ < text_.size() && text_[pos_] == '0')
+            pos_ ++;
+        else if (!digits())
+            return fail("invalid value");
+        if (pos_ < text_.size() && text_[pos_] == '.')
+        {
+            pos_ ++;
+            if (!digits())
+                return fail("invalid number");
+        }
+        if (pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E'))
+        {
+            pos_ ++;
+            if (pos_ < text_.size() && (text_[pos_] == '+' || text_[pos_] == '-'))
+                pos_ ++;
+            if (!digits())
+                return fail("invalid number");
+        }
+        result = std::strtod(text_.substr(start, pos_ - start).c_str(), nullptr);
+        return true;
+    }
+
+    bool hex4(unsigned &code)
+    {
+        if (pos_ + 4 > text_.size())
+            return fail("invalid escape");
+        code = 0;
+        for (int i = 0; i < 4; i ++)
+        {
+            char c = text_[pos_ ++];
+            code <<= 4;
+            if (c >= '0' && c <= '9')
+                code |= unsigned(c - '0');
+            else if (c >= 'a' && c <= 'f')
+                code |= unsigned(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F')
+                code |= unsigned(c - 'A' + 10);
+            else
+                return fail("invalid escape");
+        }
+        return true;
+    }
+
+    static void utf8(unsigned code, std::string &out)
+    {
+        if (code < 0x80)
+            out += char(code);
+        else if (code < 0x800)
+        {
+            out += char(0xc0 | (code >> 6));
+            out += char(0x80 | (code & 0x3f));
+        }
+        else if (code < 0x10000)
+        {
+            out += char(0xe0 | (code >> 12));
+            out += char(0x80 | ((code >> 6) & 0x3f));
+            out += char(0x80 | (code & 0x3f));
+        }
+        else
+        {
+            out += char(0xf0 | (code >> 18));
+            out += char(0x80 | ((code >> 12) & 0x3f));
+            out += char(0x80 | ((code >> 6) & 0x3f));
+            out += char(0x80 | (code & 0x3f));
+        }
+    }
+
+    bool string(std::string &out)
+    {
+        pos_ ++;    // '"'
+        out.clear();
+        while (pos_ < text_.size())
+        {
+            char c = text_[pos_ ++];
+            if (c == '"')
+                return true;
+            if ((unsigned char)c < 0x20)
+                return fail("control character in string");
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+            if (pos_ >= text_.size())
+                break;
+            c = text_[pos_ ++];
+            switch (c)
+            {
+            case '"':  out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/':  out += '/'; break;
+            case 'b':  out += '\b'; break;
+            case 'f':  out += '\f'; break;
+            case 'n':  out += '\n'; break;
+            case 'r':  out += '\r'; break;
+            case 't':  out += '\t'; break;
+            case 'u':
+            {
+                unsigned code;
+                if (!hex4(code))
+                    return false;
+                // 代理对
+                if (code >= 0xd800 && code < 0xdc00)
+                {
+                    unsigned low;
+                    if (text_.compare(pos_, 2, "\\u") || (pos_ += 2, !hex4(low)) || low < 0xdc00 || low >= 0xe000)
+                        return fail("invalid surrogate pair");
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                }
+                else if (code >= 0xdc00 && code < 0xe000)
+                    return fail("invalid surrogate pair");
+                utf8(code, out);
+                break;
+            }
+            default:
+                return fail("invalid escape");
+            }
+        }
+        return fail("unterminated string");
+    }
+
+    bool array(json::Value &value, int depth)
+    {
+        pos_ ++;    // '['
+        skip();
+        if (pos_ < text_.size() && text_[pos_] == ']')
+        {
+            pos_ ++;
+            return true;
+        }
+        for (;;)
+        {
+            value.array.emplace_back();
+            if (!parse(value.array.back(), depth + 1))
+                return false;
+            skip();
+            if (pos_ < text_.size() && text_[pos_] == ',')
+            {
+                pos_ ++;
+                skip();
+                continue;
+            }
+            if (pos_ < text_.size() && text_[pos_] == ']')
+            {
+                pos_ ++;
+                return true;
+            }
+            return fail("expected ',' or ']'");
+        }
+    }
+
+    bool object(json::Value &value, int depth)
+    {
+        pos_ ++;    // '{'
+        skip();
+        if (pos_ < text_.size() && text_[pos_] == '}')
+        {
+            pos_ ++;
+            return true;
+        }
+        for (;;)
+        {
+            if (pos_ >= text_.size() || text_[pos_] != '"')
+                return fail("expected string key");
+            value.object.emplace_back();
+            if (!string(value.object.back().first))
+                return false;
+            skip();
+            if (pos_ >= text_.size() || text_[pos_] != ':')
+                return fail("expected ':'");
+            pos_ ++;
+            skip();
+            if (!parse(value.object.back().second, depth + 1))
+                return false;
+            skip();
+            if (pos_ < text_.size() && text_[pos_] == ',')
+            {
+                pos_ ++;
+                skip();
+                continue;
+            }
+            if (pos_ < text_.size() && text_[pos_] == '}')
+            {
+                pos_ ++;
+                return true;
+            }
+            return fail("expected ',' or '}'");
+        }
+    }
+
+    const std::string &text_;
+    size_t pos_;
+    std::string error_;
+};
+
+void dumpTo(const json::Value &value, std::string &out)
+{
+    switch (value.type)
+    {
+    case json::Value::NUL:
+        out += "null";
+        break;
+    case json::Value::BOOL:
+        out += value.boolean ? "true" : "false";
+        break;
+    case json::Value::NUMBER:
+    {
+        // 非有限值在 JSON 中没有表示
+        if (!std::isfinite(value.number))
+        {
+            out += "null";
+            break;
+        }
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.17g", value.number);
+        out += buf;
+        break;
+    }
+    case json::Value::STRING:
+        out += json::quote(value.string);
+        break;
+    case json::Value::ARRAY:
+        out += '[';
+        for (size_t i = 0; i < value.array.size(); i ++)
+        {
+            if (i)
+                out += ',';
+            dumpTo(value.array[i], out);
+        }
+        out += ']';
+        break;
+    case json::Value::OBJECT:
+        out += '{';
+        for (size_t i = 0; i < value.object.size(); i ++)
+        {
+            if (i)
+                out += ',';
+            out += json::quote(value.object[i].first);
+            out += ':';
+            dumpTo(value.object[i].second, out);
+        }
+        out += '}';
+        break;
+    }
+}
+}
+
+const json::Value *json::Value::get(const std::string &key) const
+{
+    if (type != OBJECT)
+        return nullptr;
+    for (const auto &member : object)
+        if (member.first == key)
+            return &member.second;
+    return nullptr;
+}
+
+bool json::parse(const std::string &text, Value &value, std::string *error)
+{
+    Parser parser(text);
+    Value v;
+    if (!parser.document(v))
+    {
+        if (error)
+            *error = parser.error();
+        return false;
+    }
+    value = std::move(v);
+    return true;
+}
+
+std::string json::dump(const Value &value)
+{
+    std::string out;
+    dumpTo(value, out);
+    return out;
+}
+
+std::string json::quote(const std::string &s)
+{
+    std::string out = "\"";
+    for (char c : s)
+    {
+        switch (c)
+        {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20)
+            {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", unsigned(c));
+                out += buf;
+            }
+            else
+                out += c;
+        }
+    }
+    return out + "\"";
+}
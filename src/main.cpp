@@ -3,11 +3,23 @@
 #include <cstdlib>
 #include <limits>
 #include <memory>
+#include <cstdio>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <iostream>
 
 #include "tgaimage.h"
 #include "model.h"
 #include "geometry.h"
 #include "mygl.h"
+#include "bench.h"
+#include "scene.h"
+#include "pipeline.h"
+#include "render.h"
+#include "server.h"
+#include "batch.h"
+#include "memstats.h"
 
 template <class t>
 using vector = std::vector<t>;
@@ -15,115 +27,156 @@ using vector = std::vector<t>;
 const int width = 800;
 const int height = 800;
 const int depth = 255;
-
-std::unique_ptr<Model> model;
-Vec3f cameraPos = Vec3f(1, 1, 3);
-Vec3f lookPos   = Vec3f(0, 0, 0);
-Vec3f upPos     = Vec3f(0, 1, 0);
-// 光线的反方向(光线从该点射向原点), 这样方便判断光线是否照到平面. (light_dir点乘法向量 > 0)
-Vec3f light_dir = Vec3f(1, 1, 1);
-
-
-// 采用Gourand着色模型的着色器
-class GouraudShader : public mygl::IShader
+// 同时在途的帧数, 每帧一份帧缓冲
+const size_t FRAMES_IN_FLIGHT = 3;
+// 自适应着色率的亮度差阈值, 见 Framebuffer::adapt_shading_rates
+const float ADAPTIVE_SHADING_THRESHOLD = 4.f;
+
+// n 个实例在 z = 0 平面上排成方阵, 第一个实例在原点, 其余向四周展开.
+// 深度缓冲只有8位, 投影也没有远平面, 可用的深度范围很窄, 所以不沿视线方向摆放.
+static void buildScene(Scene &scene, int model, int n)
 {
-public:
-    // written by vertex shader, read by fragment shader
-    Vec3f varying_intensity;
-
-    // 用矩阵存三个点的纹理坐标, written by vertex shader, read by fragment shader
-    Matrix<2, 3, float> varying_uv;
-
-    Matrix<4, 4, float> uniform_M;   //  Projection*ModelView
-    Matrix<4, 4, float> uniform_MIT; // (Projection*ModelView).invert_transpose()
-
-    // iface为三角形编号, nthvert为顶点编号, 返回屏幕坐标
-    virtual Vec4f vertex(int iface, int nthvert) override
+    int side = int(std::ceil(std::sqrt(float(n))));
+    float scale = n > 1 ? 0.15f : 1.f;
+    float spacing = 2.5f * scene.model(model).radius() * scale;
+    for (int i = 0; i < n; i ++)
     {
-        using namespace mygl;
-
-        varying_uv.set_col(nthvert, model->texture(iface, nthvert));
-        varying_intensity[nthvert] = std::max(0.f, model->normal(iface, nthvert) * light_dir); // get diffuse lighting intensity
-
-        Vec4f gl_Vertex = embed<4>(model->vert(iface, nthvert), 1.0f); // read the vertex from .obj file
-        return viewport *  projection *  modelView * gl_Vertex; // transform it to screen coordinates
+        Matrix4f m = Matrix4f::identity();
+        int col = i % side, row = i / side;
+        for (int k = 0; k < 3; k ++)
+            m[k][k] = scale;
+        m[0][3] = ((col + 1) / 2) * ((col & 1) ? spacing : -spacing);
+        m[1][3] = ((row + 1) / 2) * ((row & 1) ? spacing : -spacing);
+        scene.add_instance(model, m);
     }
+    scene.build();
+}
 
-    // bar为当前像素相对于三角形的重心坐标, color为当前像素的颜色, 返回是否丢弃该像素
-    virtual bool fragment(Vec3f bar, TGAColor &color) override
-    {
-        // 通过重心坐标插值计算当前点的纹理坐标
-        Vec2f uv = varying_uv * bar;
-        // 法线
-        Vec3f n = proj<3>(uniform_MIT * embed<4>(model->normal(uv))).normalize();
-        // 光的方向
-        Vec3f l = proj<3>(uniform_M   * embed<4>(light_dir        )).normalize();
-        // 反射光方向
-        Vec3f r = (n * (n * l * 2.f) - l).normalize();
-
-        // specular镜面反射
-        float spec = pow(std::max(r.z, 0.0f), model->specular(uv));
-        // 漫反射, 即intensity
-        float diff = std::max(0.f, n * l);
-
-        // color = TGAColor(255, 255, 255) * intensity;
-        color = model->getTexture(uv) * diff;
-        for (int i = 0; i < 3; i ++)
-            // 环境分量系数取5, 漫反射分量系数取1, 镜面反射分量取0.6, 但是通常系数之和要等于1
-            color[i] = std::min<float>(5 + color[i] * (1 * diff + 0.6f * spec), 255);
-
-        // 是否丢弃该像素
-        return false;
-    }
-};
+static void printMemory()
+{
+    memstats::print(std::cerr);
+}
 
+// 用法: tinyRenderer [帧数] [--compress] [--material] [--instances n] [--stream KB] [--threads n] [--msaa] [--vrs r] [--budget ms]
+//                   [--animate n] [--dirty] [--verbose], 多帧时相机绕y轴旋转一周
+//       --material 未压缩时使用交错的材质贴图, 见 Model::set_material
+//       --verbose 每帧输出一行统计, 见 FramePipeline::set_verbose
+//       --threads 为任务图的工作线程数, 默认为硬件线程数
+//       --msaa 4x 多重采样抗锯齿
+//       --budget 动态分辨率, 按前面各帧的耗时降低内部分辨率使每帧不超过 ms 毫秒, 输出时放大到 800x800
+//       --animate 相机不动, 改为前 n 个实例各自绕竖直轴旋转一周, 其余实例静止
+//       --dirty 增量重画, 只重画有实例移动的屏幕分块
+//       --vrs 2 | 4 | adaptive 可变着色率: 每 2x2 或 4x4 个像素着色一次, 或者按上一帧的图像内容逐分块选择
+//       --stream 按不超过 KB 千字节的内存分批读取网格并绘制 (只画一个实例, 总是 0 级 LOD)
+//       tinyRenderer --batch <n | poses.txt> [threads] [memory MB], 见 batch.h
+//       tinyRenderer --server [workers] [queue] [memory MB], 见 server.h
+//       tinyRenderer --bench <name> [args]
 int main(int argc, char **argv)
 {
-    model = std::make_unique<Model>("../data/african_head.obj");
-
-    mygl::viewMatrix(cameraPos, lookPos, upPos);
-    mygl::viewportMatrix(width / 8, height / 8, width * 3 / 4, height * 3 / 4);
-    mygl::projectionMatrix( -1.f / (cameraPos - lookPos).norm());
-    light_dir.normalize();
-
-    TGAImage image  (width, height, TGAImage::RGB);
-    TGAImage zbuffer(width, height, TGAImage::GRAYSCALE);
-    GouraudShader shader;
-    shader.uniform_M   = mygl::projection * mygl::modelView;
-    // shader.uniform_MIT = (mygl::projection * mygl::modelView).invert_transpose();
-    shader.uniform_MIT = Matrix4f();
-    shader.uniform_MIT[0][0] = 1;
-    shader.uniform_MIT[0][1] = 0;
-    shader.uniform_MIT[0][2] = 0;
-    shader.uniform_MIT[0][3] = 0;
-
-    shader.uniform_MIT[1][0] = 0;
-    shader.uniform_MIT[1][1] = 1;
-    shader.uniform_MIT[1][2] = 0;
-    shader.uniform_MIT[1][3] = 0;
-
-    shader.uniform_MIT[2][0] = 0;
-    shader.uniform_MIT[2][1] = 0;
-    shader.uniform_MIT[2][2] = 1;
-    shader.uniform_MIT[2][3] = 0;
-
-    shader.uniform_MIT[3][0] = 0;
-    shader.uniform_MIT[3][1] = 0;
-    shader.uniform_MIT[3][2] = 0.333333;
-    shader.uniform_MIT[3][3] = 1;
-
-    for (int i = 0; i < model->nfaces(); i ++)
+    // 所有模式退出时都输出各类内存的当前值和峰值
+    std::atexit(printMemory);
+    int frames = 1;
+    int instances = 1;
+    bool compress = false;
+    bool material = false;
+    size_t streamCap = 0;
+    size_t nthreads = 0;
+    int samples = 1;
+    int shadingRate = 1;
+    bool adaptive = false;
+    double budget = 0;
+    int animated = 0;
+    bool dirty = false;
+    bool verbose = false;
+    for (int i = 1; i < argc; i ++)
     {
-        Vec4f screen_coords[3];
-        for (int j = 0; j < 3; j ++)
-            screen_coords[j] = shader.vertex(i, j);
-        triangle(screen_coords, shader, image, zbuffer);
+        std::string arg = argv[i];
+        if (arg == "--bench")
+            return bench::run(argc - i - 1, argv + i + 1);
+        else if (arg == "--batch")
+            return batch::run(argc - i - 1, argv + i + 1);
+        else if (arg == "--server")
+            return server::run(argc - i - 1, argv + i + 1);
+        else if (arg == "--compress")
+            compress = true;
+        else if (arg == "--material")
+            material = true;
+        else if (arg == "--msaa")
+            samples = mygl::Framebuffer::MAX_SAMPLES;
+        else if (arg == "--animate" && i + 1 < argc)
+            animated = std::max(0, std::atoi(argv[++ i]));
+        else if (arg == "--dirty")
+            dirty = true;
+        else if (arg == "--verbose")
+            verbose = true;
+        else if (arg == "--budget" && i + 1 < argc)
+            budget = std::max(0.0, std::atof(argv[++ i]));
+        else if (arg == "--vrs" && i + 1 < argc)
+        {
+            adaptive = std::string(argv[++ i]) == "adaptive";
+            shadingRate = adaptive ? 1 : std::max(1, std::atoi(argv[i]));
+        }
+        else if (arg == "--instances" && i + 1 < argc)
+            instances = std::max(1, std::atoi(argv[++ i]));
+        else if (arg == "--threads" && i + 1 < argc)
+            nthreads = size_t(std::max(1, std::atoi(argv[++ i])));
+        else if (arg == "--stream" && i + 1 < argc)
+            streamCap = size_t(std::max(1, std::atoi(argv[++ i]))) * 1024;
+        else
+            frames = std::max(1, std::atoi(argv[i]));
     }
 
-    image.flip_vertically();
-    zbuffer.flip_vertically();
-    image.write_tga_file("output.tga");
-    zbuffer.write_tga_file("zbuffer.tga");
+    const char *filename = "../data/african_head.obj";
+    Scene scene;
+    int head = scene.add_model(std::make_shared<Model>(filename, Texture::LINEAR, compress, true, nullptr, !streamCap));
+    // 流式绘制时网格不常驻内存, 由 MeshStream 自己报告打不开的文件
+    if (!streamCap && scene.model(head).nfaces() == 0)
+    {
+        std::cerr << "failed to load model " << filename << std::endl;
+        return 1;
+    }
+    // 流式绘制时没有包围球, 不建场景, 直接画原点处的一个实例
+    if (!streamCap)
+        buildScene(scene, head, instances);
+    // 法线贴图的变换与相机无关, 开始前做一次, 之后各帧的任务只读模型
+    for (int m = 0; m < scene.nmodels(); m ++)
+    {
+        scene.model(m).set_material(material);
+        scene.model(m).prepare_view_normals(normalMatrix());
+    }
 
-    return 0;
+    // 几何, 分条光栅化和输出都是任务图上的节点, 最多 FRAMES_IN_FLIGHT 帧同时在途
+    mygl::Scheduler scheduler(nthreads);
+    FramePipeline pipeline(scene, width, height, FRAMES_IN_FLIGHT, scheduler, samples);
+    pipeline.set_shading_rate(shadingRate);
+    pipeline.set_frame_budget(budget);
+    pipeline.set_incremental(dirty);
+    pipeline.set_verbose(verbose);
+    if (adaptive)
+        pipeline.set_adaptive_shading(ADAPTIVE_SHADING_THRESHOLD);
+    if (streamCap)
+        pipeline.set_stream(filename, streamCap, head);
+    animated = streamCap ? 0 : std::min(animated, scene.ninstances());
+    std::vector<Matrix4f> rest;
+    for (int i = 0; i < animated; i ++)
+        rest.push_back(scene.instance(i).transform);
+    for (int f = 0; f < frames; f ++)
+    {
+        if (animated)
+        {
+            // 模型空间中绕 y 轴旋转, 实例的位置不变
+            float angle = 2.f * M_PI * f / frames;
+            Matrix4f spin = Matrix4f::identity();
+            spin[0][0] = spin[2][2] = std::cos(angle);
+            spin[0][2] = std::sin(angle);
+            spin[2][0] = -std::sin(angle);
+            for (int i = 0; i < animated; i ++)
+                scene.set_transform(i, rest[i] * spin);
+            scene.refit();
+        }
+        Camera camera = animated ? Camera() : turntable(Camera(), f, frames);
+        pipeline.submit(camera, frameName("output", f, frames), frameName("zbuffer", f, frames));
+    }
+    pipeline.flush();
+    return pipeline.failures() == 0 ? 0 : 1;
 }
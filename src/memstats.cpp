@@ -0,0 +1,141 @@
+#include <cstdio>
+#include <ostream>
+#include "memstats.h"
+
+namespace
+{
+std::atomic<size_t> g_current[memstats::CATEGORIES];
+std::atomic<size_t> g_peak[memstats::CATEGORIES];
+std::atomic<size_t> g_total(0);
+std::atomic<size_t> g_total_peak(0);
+
+thread_local memstats::Job *t_job = nullptr;
+
+template <class T>
+void raisePeak(std::atomic<T> &peak, T value)
+{
+    T seen = peak.load(std::memory_order_relaxed);
+    while (seen < value && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+        ;
+}
+
+void account(memstats::Category category, size_t from, size_t to)
+{
+    if (from == to)
+        return;
+    if (to > from)
+    {
+        size_t d = to - from;
+        raisePeak(g_peak[category], g_current[category].fetch_add(d, std::memory_order_relaxed) + d);
+        raisePeak(g_total_peak, g_total.fetch_add(d, std::memory_order_relaxed) + d);
+    }
+    else
+    {
+        g_current[category].fetch_sub(from - to, std::memory_order_relaxed);
+        g_total.fetch_sub(from - to, std::memory_order_relaxed);
+    }
+    if (t_job)
+        t_job->add((long long)to - (long long)from);
+}
+}
+
+const char *memstats::name(Category category)
+{
+    static const char *names[CATEGORIES] = {"mesh", "diffuse map", "specular map", "normal map", "material map",
+                                            "texture", "framebuffer", "depth", "transient", "io"};
+    return category >= 0 && category < CATEGORIES ? names[category] : "?";
+}
+
+memstats::Usage memstats::usage(Category category)
+{
+    Usage u;
+    u.current = g_current[category].load(std::memory_order_relaxed);
+    u.peak    = g_peak[category].load(std::memory_order_relaxed);
+    return u;
+}
+
+memstats::Usage memstats::total()
+{
+    Usage u;
+    u.current = g_total.load(std::memory_order_relaxed);
+    u.peak    = g_total_peak.load(std::memory_order_relaxed);
+    return u;
+}
+
+void memstats::print(std::ostream &out)
+{
+    char line[96];
+    std::snprintf(line, sizeof(line), "# %-14s %12s %12s\n", "memory", "current KB", "peak KB");
+    out << line;
+    for (int c = 0; c < CATEGORIES; c ++)
+    {
+        Usage u = usage(Category(c));
+        std::snprintf(line, sizeof(line), "# %-14s %12zu %12zu\n", name(Category(c)), u.current / 1024, u.peak / 1024);
+        out << line;
+    }
+    Usage u = total();
+    std::snprintf(line, sizeof(line), "# %-14s %12zu %12zu\n", "total", u.current / 1024, u.peak / 1024);
+    out << line << std::flush;
+}
+
+size_t memstats::Job::current() const
+{
+    long long c = current_.load(std::memory_order_relaxed);
+    return c > 0 ? size_t(c) : 0;
+}
+
+size_t memstats::Job::peak() const
+{
+    long long p = peak_.load(std::memory_order_relaxed);
+    return p > 0 ? size_t(p) : 0;
+}
+
+void memstats::Job::add(long long delta)
+{
+    raisePeak(peak_, current_.fetch_add(delta, std::memory_order_relaxed) + delta);
+}
+
+memstats::JobScope::JobScope(Job &job) : previous_(t_job)
+{
+    t_job = &job;
+}
+
+memstats::JobScope::~JobScope()
+{
+    t_job = previous_;
+}
+
+memstats::Tracker &memstats::Tracker::operator=(const Tracker &other)
+{
+    if (this != &other)
+        set(other.category_, other.bytes_);
+    return *this;
+}
+
+memstats::Tracker &memstats::Tracker::operator=(Tracker &&other) noexcept
+{
+    if (this != &other)
+    {
+        set(0);
+        category_ = other.category_;
+        bytes_    = other.bytes_;
+        other.bytes_ = 0;
+    }
+    return *this;
+}
+
+void memstats::Tracker::set(size_t bytes)
+{
+    account(category_, bytes_, bytes);
+    bytes_ = bytes;
+}
+
+void memstats::Tracker::set(Category category, size_t bytes)
+{
+    if (category != category_)
+    {
+        set(0);
+        category_ = category;
+    }
+    set(bytes);
+}
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include "mesh.h"
+#include "meshcache.h"
+#include "meshopt.h"
+
+std::shared_ptr<MeshAsset> MeshAsset::load(const char *filename, bool optimize)
+{
+    auto mesh = std::make_shared<MeshAsset>();
+
+    // 优化过的网格和 LOD 存在 OBJ 旁边的缓存文件里, 源文件没变时直接读取
+    std::string cachePath = std::string(filename) + ".meshcache";
+    uint64_t stamp = meshcache::source_stamp(filename);
+    bool cached = optimize && stamp && meshcache::load(cachePath, stamp, mesh->vertices, mesh->lods, mesh->counts);
+    if (!cached)
+    {
+        if (!mesh->load_obj(filename))
+            return nullptr;
+        if (optimize)
+        {
+            mesh->optimize();
+            mesh->build_lods();
+            if (!meshcache::save(cachePath, stamp, mesh->vertices, mesh->lods, mesh->counts))
+                std::cerr << "failed to write mesh cache " << cachePath << std::endl;
+        }
+    }
+    std::cerr << "# v# " << mesh->counts.nverts << std::endl;
+    std::cerr << "# f# " << mesh->lods[0].nfaces() << std::endl;
+    std::cerr << "# vt# " << mesh->counts.ntextures << std::endl;
+    std::cerr << "# vn# " << mesh->counts.nnormals << std::endl;
+    std::cerr << "# lod#" << (cached ? " (cached)" : "");
+    for (const Mesh &m : mesh->lods)
+        std::cerr << " " << m.nfaces();
+    std::cerr << std::endl;
+
+    // 包围球, 用于按屏幕尺寸选择 LOD
+    const std::vector<Vertex> &vertices = mesh->vertices;
+    Vec3f lo = vertices[0].pos, hi = vertices[0].pos;
+    for (const Vertex &v : vertices)
+        for (int i = 0; i < 3; i ++)
+        {
+            lo[i] = std::min(lo[i], v.pos[i]);
+            hi[i] = std::max(hi[i], v.pos[i]);
+        }
+    mesh->center = (lo + hi) / 2.f;
+    for (const Vertex &v : vertices)
+        mesh->radius = std::max(mesh->radius, (v.pos - mesh->center).norm());
+
+    size_t bytes = vertices.capacity() * sizeof(Vertex);
+    for (const Mesh &m : mesh->lods)
+        bytes += m.indices.capacity() * sizeof(int);
+    mesh->memory.set(bytes);
+    return mesh;
+}
+
+namespace
+{
+// OBJ 的下标从 1 开始, 负数为从已经读到的最后一个往前数. 转换成从 0 开始的下标, 为 0 或者越界时返回 false
+bool objIndex(int &i, size_t n)
+{
+    long long r = i > 0 ? i - 1LL : (long long)n + i;
+    if (i == 0 || r < 0 || r >= (long long)n)
+        return false;
+    i = int(r);
+    return true;
+}
+
+// (v, vt, vn) 三元组, 每个下标完整保留, 不同三元组不会合并
+using Corner = std::array<int, 3>;
+
+struct CornerHash
+{
+    size_t operator()(const Corner &c) const
+    {
+        uint64_t h = uint32_t(c[0]);
+        h = h * 0x9e3779b97f4a7c15ull + uint32_t(c[1]);
+        h = h * 0x9e3779b97f4a7c15ull + uint32_t(c[2]);
+        return size_t(h ^ (h >> 29));
+    }
+};
+}
+
+bool MeshAsset::load_obj(const char *filename)
+{
+    std::ifstream in;
+    in.open(filename, std::ifstream::in);
+    if (in.fail())
+        return false;
+
+    std::vector<Vec3f> verts;
+    std::vector<Vec3f> normals;
+    std::vector<Vec2f> textures;
+    std::vector<int> indices;
+    // (v, vt, vn) 三元组 -> 顶点编号
+    std::unordered_map<Corner, int, CornerHash> unique;
+    std::string line;
+    for (int lineno = 1; !in.eof(); lineno ++)
+    {
+        std::getline(in, line);
+        std::istringstream iss(line.c_str());
+        char trash;
+        std::string strash;
+        if (!line.compare(0, 2, "v "))
+        {
+            iss >> trash;
+            Vec3f v;
+            for (int i = 0; i < 3; i++)
+                iss >> v[i];
+            verts.push_back(v);
+        }
+        else if (!line.compare(0, 2, "f "))
+        {
+            iss >> trash;
+            std::string corner;
+            int corners = 0;
+            // 只取前三个顶点, 与原来的 Trangle 一致
+            while (corners < 3 && iss >> corner)
+            {
+                // 着色需要纹理坐标和法线, 只接受 v/vt/vn. 格式不对或者下标越界时整个文件加载失败
+                int idx, vtidx, nidx;
+                char extra;
+                if (std::sscanf(corner.c_str(), "%d/%d/%d%c", &idx, &vtidx, &nidx, &extra) != 3 ||
+                    !objIndex(idx, verts.size()) || !objIndex(vtidx, textures.size()) || !objIndex(nidx, normals.size()))
+                {
+                    std::cerr << filename << ":" << lineno << ": bad face vertex " << corner << std::endl;
+                    return false;
+                }
+                Corner key = {idx, vtidx, nidx};
+                auto it = unique.find(key);
+                if (it == unique.end())
+                {
+                    it = unique.emplace(key, int(vertices.size())).first;
+                    vertices.push_back(Vertex{verts[idx], normals[nidx], textures[vtidx]});
+                }
+                indices.push_back(it->second);
+                corners ++;
+            }
+            // 不足三个顶点的面补成退化三角形
+            for (; corners > 0 && corners < 3; corners ++)
+                indices.push_back(indices.back());
+        }
+        else if (!line.compare(0, 4, "vt  "))
+        {
+            iss >> strash;
+            Vec2f t;
+            for (int i = 0; i < 2; i++)
+                iss >> t[i];
+            textures.push_back(t);
+        }
+        else if (!line.compare(0, 4, "vn  "))
+        {
+            iss >> strash;
+            Vec3f t;
+            for (int i = 0; i < 3; i ++)
+                iss >> t[i];
+            normals.push_back(t);
+        }
+    }
+    counts.nverts    = int(verts.size());
+    counts.ntextures = int(textures.size());
+    counts.nnormals  = int(normals.size());
+    lods.assign(1, Mesh());
+    lods[0].indices.swap(indices);
+    return !vertices.empty();
+}
+
+// 顶点缓存优化 -> 按簇的 overdraw 排序 -> 按首次使用重排顶点
+void MeshAsset::optimize()
+{
+    std::vector<int> &indices = lods[0].indices;
+    int nvertices = int(vertices.size());
+
+    std::vector<Vec3f> positions(nvertices);
+    for (int i = 0; i < nvertices; i ++)
+        positions[i] = vertices[i].pos;
+    indices = meshopt::optimize_vertex_cache(indices, nvertices);
+    indices = meshopt::optimize_overdraw(indices, positions);
+
+    std::vector<int> remap = meshopt::optimize_vertex_fetch(indices, nvertices);
+    std::vector<Vertex> reordered(nvertices);
+    int used = 0;
+    for (int i = 0; i < nvertices; i ++)
+    {
+        if (remap[i] >= 0)
+        {
+            reordered[remap[i]] = vertices[i];
+            used ++;
+        }
+    }
+    reordered.resize(used);
+    vertices.swap(reordered);
+}
+
+// 每级目标三角形数为上一级的 1/4, 都从原始网格简化, 误差是相对原始网格的.
+// 简化不动 (接缝和边界锁住的部分占了大多数) 时停止.
+void MeshAsset::build_lods()
+{
+    std::vector<Vec3f> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i ++)
+        positions[i] = vertices[i].pos;
+
+    for (int target = lods[0].nfaces() / 4; target >= MIN_LOD_FACES; target /= 4)
+    {
+        Mesh lod;
+        lod.indices = meshopt::simplify(lods[0].indices, positions, target, std::numeric_limits<float>::max(), &lod.error);
+        if (lod.nfaces() > lods.back().nfaces() * 3 / 4)
+            break;
+        lod.indices = meshopt::optimize_vertex_cache(lod.indices, int(vertices.size()));
+        lods.push_back(std::move(lod));
+    }
+}
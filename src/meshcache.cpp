@@ -0,0 +1,144 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "meshcache.h"
+
+namespace
+{
+const char MAGIC[8] = {'T', 'R', 'M', 'E', 'S', 'H', 0, 0};
+// 网格优化或简化的算法变化时加一, 旧缓存随之失效
+const uint32_t VERSION = 1;
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nlods;
+    uint64_t stamp;
+    uint32_t nvertices;
+    int32_t nverts, ntextures, nnormals;
+};
+
+template <class T>
+bool readPod(std::istream &in, T *data, size_t n = 1)
+{
+    return bool(in.read(reinterpret_cast<char *>(data), sizeof(T) * n));
+}
+
+template <class T>
+void writePod(std::ostream &out, const T *data, size_t n = 1)
+{
+    out.write(reinterpret_cast<const char *>(data), sizeof(T) * n);
+}
+}
+
+uint64_t meshcache::source_stamp(const char *filename)
+{
+    std::error_code ec;
+    auto size = std::filesystem::file_size(filename, ec);
+    if (ec)
+        return 0;
+    auto time = std::filesystem::last_write_time(filename, ec);
+    if (ec)
+        return 0;
+    return (uint64_t(time.time_since_epoch().count()) * 1000003u) ^ uint64_t(size);
+}
+
+bool meshcache::load(const std::string &path, uint64_t stamp, std::vector<Vertex> &vertices, std::vector<Mesh> &lods,
+                     SourceCounts &counts)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    Header h;
+    if (!readPod(in, &h) || std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) || h.version != VERSION || h.stamp != stamp ||
+        h.nlods == 0)
+        return false;
+
+    std::vector<Vertex> v(h.nvertices);
+    if (!readPod(in, v.data(), v.size()))
+        return false;
+    std::vector<Mesh> l(h.nlods);
+    for (Mesh &m : l)
+    {
+        uint32_t nindices;
+        if (!readPod(in, &m.error) || !readPod(in, &nindices) || nindices % 3)
+            return false;
+        m.indices.resize(nindices);
+        if (!readPod(in, m.indices.data(), nindices))
+            return false;
+        for (int i : m.indices)
+            if (i < 0 || uint32_t(i) >= h.nvertices)
+                return false;
+    }
+
+    vertices.swap(v);
+    lods.swap(l);
+    counts.nverts    = h.nverts;
+    counts.ntextures = h.ntextures;
+    counts.nnormals  = h.nnormals;
+    return true;
+}
+
+bool meshcache::locate(const std::string &path, uint64_t stamp, Layout &layout)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    Header h;
+    if (!readPod(in, &h) || std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) || h.version != VERSION || h.stamp != stamp ||
+        h.nlods == 0)
+        return false;
+
+    Layout l;
+    l.nvertices     = h.nvertices;
+    l.vertex_offset = sizeof(Header);
+    float error;
+    in.seekg(std::streamoff(l.vertex_offset + uint64_t(h.nvertices) * sizeof(Vertex)));
+    if (!readPod(in, &error) || !readPod(in, &l.nindices) || l.nindices % 3)
+        return false;
+    l.index_offset = uint64_t(in.tellg());
+    layout = l;
+    return true;
+}
+
+bool meshcache::save(const std::string &path, uint64_t stamp, const std::vector<Vertex> &vertices,
+                     const std::vector<Mesh> &lods, const SourceCounts &counts)
+{
+    // 先写临时文件再改名, 其他进程不会读到写了一半的缓存
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        Header h;
+        std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+        h.version   = VERSION;
+        h.nlods     = uint32_t(lods.size());
+        h.stamp     = stamp;
+        h.nvertices = uint32_t(vertices.size());
+        h.nverts    = counts.nverts;
+        h.ntextures = counts.ntextures;
+        h.nnormals  = counts.nnormals;
+        writePod(out, &h);
+        writePod(out, vertices.data(), vertices.size());
+        for (const Mesh &m : lods)
+        {
+            uint32_t nindices = uint32_t(m.indices.size());
+            writePod(out, &m.error);
+            writePod(out, &nindices);
+            writePod(out, m.indices.data(), nindices);
+        }
+        if (!out)
+            return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec)
+    {
+        std::error_code ignore;
+        std::filesystem::remove(tmp, ignore);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,575 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include "meshopt.h"
+
+float meshopt::acmr(const std::vector<int> &indices, int nverts, int cache_size)
+{
+    if (indices.size() < 3)
+        return 0.f;
+    // stamp 为顶点进入 FIFO 时的序号, 之后又进入 cache_size 个顶点就被挤出
+    std::vector<int> stamp(nverts, -1);
+    int time = 0, misses = 0;
+    for (int v : indices)
+    {
+        if (stamp[v] < 0 || time - stamp[v] >= cache_size)
+        {
+            stamp[v] = time ++;
+            misses ++;
+        }
+    }
+    return float(misses) / (indices.size() / 3);
+}
+
+namespace
+{
+// 打分用的 LRU 缓存大小, 比硬件 FIFO 大一些, 结果对具体的缓存大小不敏感
+constexpr int LRU_SIZE = 32;
+
+// 刚用过的三个顶点分数固定, 避免总是选中共享边的三角形形成细长条带;
+// 剩余三角形越少的顶点加分越多, 尽快用完它, 不留下孤立的三角形
+float vertexScore(int cache_pos, int remaining)
+{
+    if (remaining == 0)
+        return -1.f;
+    float score = 0.f;
+    if (cache_pos >= 0)
+    {
+        if (cache_pos < 3)
+            score = 0.75f;
+        else
+            score = std::pow(1.f - float(cache_pos - 3) / (LRU_SIZE - 3), 1.5f);
+    }
+    return score + 2.f / std::sqrt(float(remaining));
+}
+}
+
+std::vector<int> meshopt::optimize_vertex_cache(const std::vector<int> &indices, int nverts)
+{
+    int nfaces = int(indices.size() / 3);
+
+    // 顶点的相邻三角形, 按顶点连续存放; remaining 为尚未输出的相邻三角形数,
+    // 输出的三角形换到区间末尾, 区间 [offset, offset + remaining) 始终是未输出的
+    std::vector<int> remaining(nverts, 0), offset(nverts + 1, 0);
+    for (int i = 0; i < nfaces * 3; i ++)
+        remaining[indices[i]] ++;
+    for (int v = 0; v < nverts; v ++)
+        offset[v + 1] = offset[v] + remaining[v];
+    std::vector<int> adjacency(nfaces * 3), fill(offset.begin(), offset.end() - 1);
+    for (int i = 0; i < nfaces * 3; i ++)
+        adjacency[fill[indices[i]] ++] = i / 3;
+
+    std::vector<int> cache_pos(nverts, -1);
+    std::vector<float> vscore(nverts);
+    for (int v = 0; v < nverts; v ++)
+        vscore[v] = vertexScore(-1, remaining[v]);
+    std::vector<float> tscore(nfaces);
+    for (int f = 0; f < nfaces; f ++)
+        tscore[f] = vscore[indices[f * 3]] + vscore[indices[f * 3 + 1]] + vscore[indices[f * 3 + 2]];
+
+    std::vector<char> emitted(nfaces, 0);
+    std::vector<int> cache, next_cache, result;
+    result.reserve(nfaces * 3);
+    int cursor = 0;
+    int best = -1;
+    for (int n = 0; n < nfaces; n ++)
+    {
+        // 缓存里的顶点都没有剩余三角形时, 从原顺序中取下一个未输出的三角形重新开始
+        if (best < 0)
+        {
+            while (emitted[cursor])
+                cursor ++;
+            best = cursor;
+        }
+
+        const int *tri = &indices[best * 3];
+        result.insert(result.end(), tri, tri + 3);
+        emitted[best] = 1;
+
+        // 从三个顶点的相邻列表中移除该三角形
+        for (int k = 0; k < 3; k ++)
+        {
+            int v = tri[k];
+            int begin = offset[v], end = offset[v] + remaining[v];
+            std::swap(*std::find(adjacency.begin() + begin, adjacency.begin() + end, best), adjacency[end - 1]);
+            remaining[v] --;
+        }
+
+        // 三个顶点移到 LRU 最前面
+        next_cache.assign(tri, tri + 3);
+        for (int v : cache)
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                next_cache.push_back(v);
+        std::swap(cache, next_cache);
+
+        // 更新缓存内顶点和刚被挤出的顶点的分数, 把差值累加到相邻的三角形上
+        for (int i = 0; i < int(cache.size()); i ++)
+        {
+            int v = cache[i];
+            cache_pos[v] = i < LRU_SIZE ? i : -1;
+            float score = vertexScore(cache_pos[v], remaining[v]);
+            float delta = score - vscore[v];
+            vscore[v] = score;
+            for (int j = offset[v]; j < offset[v] + remaining[v]; j ++)
+                tscore[adjacency[j]] += delta;
+        }
+        if (int(cache.size()) > LRU_SIZE)
+            cache.resize(LRU_SIZE);
+
+        // 下一个三角形只从缓存内顶点的相邻三角形中选
+        best = -1;
+        float best_score = -1.f;
+        for (int v : cache)
+        {
+            for (int j = offset[v]; j < offset[v] + remaining[v]; j ++)
+            {
+                int f = adjacency[j];
+                if (tscore[f] > best_score)
+                {
+                    best_score = tscore[f];
+                    best = f;
+                }
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<int> meshopt::optimize_overdraw(const std::vector<int> &indices, const std::vector<Vec3f> &positions)
+{
+    int nfaces = int(indices.size() / 3);
+    if (nfaces == 0)
+        return indices;
+
+    // 切分簇: 每个簇从空缓存开始模拟 FIFO, 簇内的 ACMR 降到全局的 threshold 倍以内就开始新簇.
+    // 簇开始时本来就假设缓存为空, 所以簇之间任意换序, ACMR 最多变差到 threshold 倍
+    const float threshold = 1.05f;
+    float limit = acmr(indices, int(positions.size())) * threshold;
+    std::vector<int> starts;
+    std::vector<int> stamp(positions.size(), -1);
+    int time = 0, start_time = 0, misses = 0, begin = 0;
+    for (int f = 0; f < nfaces; f ++)
+    {
+        for (int k = 0; k < 3; k ++)
+        {
+            int v = indices[f * 3 + k];
+            if (stamp[v] < start_time || time - stamp[v] >= FIFO_SIZE)
+            {
+                stamp[v] = time ++;
+                misses ++;
+            }
+        }
+        if (f == begin)
+            starts.push_back(f);
+        if (misses <= limit * (f - begin + 1))
+        {
+            begin = f + 1;
+            start_time = time;
+            misses = 0;
+        }
+    }
+    starts.push_back(nfaces);
+
+    // 面积加权的网格中心, 以及每个簇的中心和平均法线
+    struct Cluster
+    {
+        int begin, end;
+        float key;
+    };
+    auto centroid = [&](int f) { return (positions[indices[f * 3]] + positions[indices[f * 3 + 1]] + positions[indices[f * 3 + 2]]) / 3.f; };
+    auto areaNormal = [&](int f)
+    {
+        const Vec3f &a = positions[indices[f * 3]];
+        return (positions[indices[f * 3 + 1]] - a) ^ (positions[indices[f * 3 + 2]] - a);
+    };
+
+    Vec3f mesh_center(0, 0, 0);
+    float mesh_area = 0.f;
+    for (int f = 0; f < nfaces; f ++)
+    {
+        float area = areaNormal(f).norm();
+        mesh_center = mesh_center + centroid(f) * area;
+        mesh_area += area;
+    }
+    if (mesh_area > 0)
+        mesh_center = mesh_center / mesh_area;
+
+    std::vector<Cluster> clusters;
+    for (size_t i = 0; i + 1 < starts.size(); i ++)
+    {
+        Vec3f center(0, 0, 0), normal(0, 0, 0);
+        float area = 0.f;
+        for (int f = starts[i]; f < starts[i + 1]; f ++)
+        {
+            Vec3f n = areaNormal(f);
+            float a = n.norm();
+            center = center + centroid(f) * a;
+            normal = normal + n;
+            area += a;
+        }
+        float key = 0.f;
+        if (area > 0 && normal.norm() > 0)
+            key = (center / area - mesh_center) * normal.normalize();
+        clusters.push_back(Cluster{starts[i], starts[i + 1], key});
+    }
+
+    // 越朝外的簇越容易遮挡其他簇, 先画
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.key > b.key; });
+
+    std::vector<int> result;
+    result.reserve(indices.size());
+    for (const Cluster &c : clusters)
+        result.insert(result.end(), indices.begin() + c.begin * 3, indices.begin() + c.end * 3);
+    return result;
+}
+
+std::vector<int> meshopt::optimize_vertex_fetch(std::vector<int> &indices, int nverts)
+{
+    std::vector<int> remap(nverts, -1);
+    int next = 0;
+    for (int &v : indices)
+    {
+        if (remap[v] < 0)
+            remap[v] = next ++;
+        v = remap[v];
+    }
+    return remap;
+}
+
+namespace
+{
+// 对称 4x4 矩阵, 只存上三角的10个元素, 另外记录平面的权重之和
+struct Quadric
+{
+    double q[10] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    double weight = 0;
+
+    // 平面 ax + by + cz + d = 0, (a, b, c) 为单位向量
+    void add_plane(double a, double b, double c, double d, double w)
+    {
+        q[0] += w * a * a; q[1] += w * a * b; q[2] += w * a * c; q[3] += w * a * d;
+        q[4] += w * b * b; q[5] += w * b * c; q[6] += w * b * d;
+        q[7] += w * c * c; q[8] += w * c * d;
+        q[9] += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric &o)
+    {
+        for (int i = 0; i < 10; i ++)
+            q[i] += o.q[i];
+        weight += o.weight;
+    }
+
+    // 到各平面距离平方的加权和
+    double error(const Vec3f &p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x +
+               q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y +
+               q[7] * z * z + 2 * q[8] * z + q[9];
+    }
+};
+
+enum VertexKind
+{
+    MANIFOLD,   // 内部顶点, 可以折叠到任意相邻顶点
+    BORDER,     // 开放边界上的顶点, 只能沿边界折叠
+    SEAM,       // 接缝上的顶点 (同一位置有两个顶点), 和另一侧的顶点成对沿接缝折叠
+    LOCKED      // 接缝交汇处, 边界的拐角等, 不折叠
+};
+
+uint64_t edgeKey(int a, int b)
+{
+    if (a > b)
+        std::swap(a, b);
+    return (uint64_t(uint32_t(a)) << 32) | uint32_t(b);
+}
+
+// 边界/接缝边: 过边且垂直于三角形的平面, 权重大, 防止折叠把边界拉离原来的位置
+const double BORDER_WEIGHT = 10.0;
+
+Vec3f triangleNormal(const Vec3f &a, const Vec3f &b, const Vec3f &c)
+{
+    return (b - a) ^ (c - a);
+}
+}
+
+std::vector<int> meshopt::simplify(const std::vector<int> &indices, const std::vector<Vec3f> &positions,
+                                   int target_faces, float max_error, float *result_error)
+{
+    int nverts = int(positions.size());
+    std::vector<int> result(indices);
+    float error = 0.f;
+
+    // 位置相同的顶点归为一组, 组内多于一个顶点说明在纹理接缝上
+    std::vector<int> group(nverts), wedges(nverts, 0), partner(nverts, -1);
+    {
+        std::map<std::tuple<float, float, float>, int> first;
+        for (int v = 0; v < nverts; v ++)
+        {
+            const Vec3f &p = positions[v];
+            group[v] = first.emplace(std::make_tuple(p.x, p.y, p.z), v).first->second;
+        }
+        for (int v = 0; v < nverts; v ++)
+        {
+            int g = group[v];
+            if (g != v && wedges[g] == 1)
+            {
+                partner[g] = v;
+                partner[v] = g;
+            }
+            wedges[g] ++;
+        }
+        for (int v = 0; v < nverts; v ++)
+            wedges[v] = wedges[group[v]];
+    }
+
+    // 顶点边 (按顶点编号) 和位置边 (按组编号) 各被几个三角形使用
+    std::unordered_map<uint64_t, int> vertex_edges, group_edges;
+    int nfaces = int(result.size() / 3);
+    for (int f = 0; f < nfaces; f ++)
+    {
+        for (int k = 0; k < 3; k ++)
+        {
+            int a = result[f * 3 + k], b = result[f * 3 + (k + 1) % 3];
+            vertex_edges[edgeKey(a, b)] ++;
+            group_edges[edgeKey(group[a], group[b])] ++;
+        }
+    }
+
+    // 顶点分类: 只有一个三角形使用的顶点边为开放边, 开放边在接缝或者边界上
+    std::vector<VertexKind> kind(nverts, MANIFOLD);
+    std::vector<int> open_edges(nverts, 0);
+    std::vector<char> border(nverts, 0), nonmanifold(nverts, 0);
+    for (int f = 0; f < nfaces; f ++)
+    {
+        for (int k = 0; k < 3; k ++)
+        {
+            int a = result[f * 3 + k], b = result[f * 3 + (k + 1) % 3];
+            int groups = group_edges[edgeKey(group[a], group[b])];
+            if (vertex_edges[edgeKey(a, b)] == 1)
+            {
+                open_edges[a] ++;
+                open_edges[b] ++;
+            }
+            if (groups == 1)
+                border[a] = border[b] = 1;
+            if (groups > 2)
+                nonmanifold[a] = nonmanifold[b] = 1;
+        }
+    }
+    for (int v = 0; v < nverts; v ++)
+    {
+        if (nonmanifold[v] || wedges[v] > 2)
+            kind[v] = LOCKED;
+        else if (wedges[v] == 2)
+            kind[v] = (open_edges[v] == 2 && !border[v] && !border[partner[v]]) ? SEAM : LOCKED;
+        else if (border[v])
+            kind[v] = open_edges[v] == 2 ? BORDER : LOCKED;
+        else
+            kind[v] = open_edges[v] == 0 ? MANIFOLD : LOCKED;
+    }
+
+    // 每个顶点的误差矩阵: 相邻三角形所在平面按面积加权, 开放边再加上垂直的平面
+    std::vector<Quadric> quadrics(nverts);
+    for (int f = 0; f < nfaces; f ++)
+    {
+        const int *t = &result[f * 3];
+        Vec3f n = triangleNormal(positions[t[0]], positions[t[1]], positions[t[2]]);
+        float len = n.norm();
+        if (len <= 0)
+            continue;
+        n = n / len;
+        double d = -(n * positions[t[0]]);
+        for (int k = 0; k < 3; k ++)
+            quadrics[t[k]].add_plane(n.x, n.y, n.z, d, len * .5);
+
+        for (int k = 0; k < 3; k ++)
+        {
+            int a = t[k], b = t[(k + 1) % 3];
+            if (vertex_edges[edgeKey(a, b)] != 1)
+                continue;
+            Vec3f e = positions[b] - positions[a];
+            Vec3f m = e ^ n;
+            float mlen = m.norm();
+            if (mlen <= 0)
+                continue;
+            m = m / mlen;
+            double md = -(m * positions[a]);
+            double w = (e * e) * BORDER_WEIGHT;
+            quadrics[a].add_plane(m.x, m.y, m.z, md, w);
+            quadrics[b].add_plane(m.x, m.y, m.z, md, w);
+        }
+    }
+
+    // 折叠后误差: 合并后的矩阵在目标点的加权平均距离平方
+    auto collapseError = [&](int u, int v)
+    {
+        Quadric q = quadrics[u];
+        q.add(quadrics[v]);
+        return q.weight > 0 ? float(std::sqrt(std::max(0.0, q.error(positions[v]) / q.weight))) : 0.f;
+    };
+
+    struct Collapse
+    {
+        int u, v;       // u 折叠到 v
+        int u2, v2;     // 接缝另一侧同时折叠, 没有时为 -1
+        float error;
+    };
+    std::vector<int> offset, adjacency, remap(nverts);
+    std::vector<char> locked(nverts);
+    std::vector<Collapse> collapses;
+
+    while (nfaces > target_faces)
+    {
+        // 顶点的相邻三角形
+        offset.assign(nverts + 1, 0);
+        for (int v : result)
+            offset[v + 1] ++;
+        for (int v = 0; v < nverts; v ++)
+            offset[v + 1] += offset[v];
+        adjacency.resize(result.size());
+        std::vector<int> fill(offset.begin(), offset.end() - 1);
+        for (int i = 0; i < int(result.size()); i ++)
+            adjacency[fill[result[i]] ++] = i / 3;
+
+        // v 的组里和 u2 相邻的顶点
+        auto partnerTarget = [&](int u2, int v)
+        {
+            for (int j = offset[u2]; j < offset[u2 + 1]; j ++)
+                for (int k = 0; k < 3; k ++)
+                {
+                    int w = result[adjacency[j] * 3 + k];
+                    if (w != u2 && group[w] == group[v] && vertex_edges.count(edgeKey(u2, w)))
+                        return w;
+                }
+            return -1;
+        };
+
+        collapses.clear();
+        for (int f = 0; f < nfaces; f ++)
+        {
+            for (int k = 0; k < 3; k ++)
+            {
+                int a = result[f * 3 + k], b = result[f * 3 + (k + 1) % 3];
+                for (int dir = 0; dir < 2; dir ++, std::swap(a, b))
+                {
+                    Collapse c{a, b, -1, -1, 0.f};
+                    bool open = vertex_edges[edgeKey(a, b)] == 1;
+                    if (kind[a] == LOCKED || ((kind[a] == BORDER || kind[a] == SEAM) && !open))
+                        continue;
+                    if (kind[a] == SEAM)
+                    {
+                        c.u2 = partner[a];
+                        c.v2 = partnerTarget(c.u2, b);
+                        if (c.v2 < 0 || c.v2 == b)
+                            continue;
+                    }
+                    c.error = collapseError(a, b);
+                    if (c.u2 >= 0)
+                        c.error = std::max(c.error, collapseError(c.u2, c.v2));
+                    if (c.error <= max_error)
+                        collapses.push_back(c);
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+        // u 移到 v 后, u 的其他相邻三角形不能翻转
+        auto flips = [&](int u, int v)
+        {
+            for (int j = offset[u]; j < offset[u + 1]; j ++)
+            {
+                const int *t = &result[adjacency[j] * 3];
+                if (t[0] == v || t[1] == v || t[2] == v)
+                    continue;
+                Vec3f p[3], q[3];
+                for (int k = 0; k < 3; k ++)
+                {
+                    p[k] = positions[t[k]];
+                    q[k] = t[k] == u ? positions[v] : p[k];
+                }
+                Vec3f n0 = triangleNormal(p[0], p[1], p[2]), n1 = triangleNormal(q[0], q[1], q[2]);
+                if (n0 * n1 <= 0)
+                    return true;
+            }
+            return false;
+        };
+        // 一轮里折叠过的顶点的一圈邻居不再参与, 保证翻转检查用到的三角形都没有变化
+        auto lockRing = [&](int u)
+        {
+            for (int j = offset[u]; j < offset[u + 1]; j ++)
+                for (int k = 0; k < 3; k ++)
+                    locked[result[adjacency[j] * 3 + k]] = 1;
+        };
+        auto removedFaces = [&](int u, int v)
+        {
+            int n = 0;
+            for (int j = offset[u]; j < offset[u + 1]; j ++)
+            {
+                const int *t = &result[adjacency[j] * 3];
+                n += t[0] == v || t[1] == v || t[2] == v;
+            }
+            return n;
+        };
+
+        std::fill(locked.begin(), locked.end(), 0);
+        for (int v = 0; v < nverts; v ++)
+            remap[v] = v;
+        int removed = 0, applied = 0;
+        for (const Collapse &c : collapses)
+        {
+            if (removed >= nfaces - target_faces)
+                break;
+            if (locked[c.u] || locked[c.v] || (c.u2 >= 0 && (locked[c.u2] || locked[c.v2])))
+                continue;
+            if (flips(c.u, c.v) || (c.u2 >= 0 && flips(c.u2, c.v2)))
+                continue;
+
+            remap[c.u] = c.v;
+            quadrics[c.v].add(quadrics[c.u]);
+            removed += removedFaces(c.u, c.v);
+            lockRing(c.u);
+            if (c.u2 >= 0)
+            {
+                remap[c.u2] = c.v2;
+                quadrics[c.v2].add(quadrics[c.u2]);
+                removed += removedFaces(c.u2, c.v2);
+                lockRing(c.u2);
+            }
+            error = std::max(error, c.error);
+            applied ++;
+        }
+        if (applied == 0)
+            break;
+
+        // 改写索引, 去掉退化的三角形
+        int n = 0;
+        for (int f = 0; f < nfaces; f ++)
+        {
+            int a = remap[result[f * 3]], b = remap[result[f * 3 + 1]], c = remap[result[f * 3 + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            result[n * 3] = a;
+            result[n * 3 + 1] = b;
+            result[n * 3 + 2] = c;
+            n ++;
+        }
+        nfaces = n;
+        result.resize(nfaces * 3);
+
+        // 折叠后重新统计顶点边, 开放边的判断要用最新的拓扑
+        vertex_edges.clear();
+        for (int f = 0; f < nfaces; f ++)
+            for (int k = 0; k < 3; k ++)
+                vertex_edges[edgeKey(result[f * 3 + k], result[f * 3 + (k + 1) % 3])] ++;
+    }
+
+    if (result_error)
+        *result_error = error;
+    return result;
+}
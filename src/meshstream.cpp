@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include "meshcache.h"
+#include "meshstream.h"
+
+namespace
+{
+// 每个打开的文件使用的读写缓冲, 由 MeshStream 自己分配, 计入内存上限
+const size_t IO_BUFFER = 4096;
+// 预留给 OBJ 一行文本的长度, 更长的行按实际占用统计
+const size_t LINE_BUFFER = 256;
+// 页缓存每页至少的记录数 (预算不够时减少), 页数最多 MAX_PAGES, 预算大时加大每页
+const size_t PAGE_RECORDS = 256;
+const size_t MAX_PAGES = 64;
+
+// v / vt / vn 临时文件的记录大小
+const size_t ATTR_SIZE[3] = {sizeof(Vec3f), sizeof(Vec2f), sizeof(Vec3f)};
+}
+
+void MeshStream::Pages::open(std::istream *in, uint64_t offset, uint64_t nrecords, size_t record, size_t budget)
+{
+    in_ = in;
+    offset_ = offset;
+    nrecords_ = nrecords;
+    record_ = record;
+    size_t fits = budget / record;
+    page_records_ = std::max<size_t>(1, std::max(std::min(PAGE_RECORDS, fits), fits / MAX_PAGES));
+    size_t npages = std::max<size_t>(1, budget / (page_records_ * record));
+    pages_.assign(npages, Page());
+    for (Page &p : pages_)
+        p.data.resize(page_records_ * record);
+}
+
+const char *MeshStream::Pages::get(uint64_t i)
+{
+    if (i >= nrecords_)
+        return nullptr;
+    uint64_t id = i / page_records_;
+    Page *victim = &pages_[0];
+    for (Page &p : pages_)
+    {
+        if (p.id == id)
+        {
+            p.used = ++ clock_;
+            return p.data.data() + (i % page_records_) * record_;
+        }
+        if (p.used < victim->used)
+            victim = &p;
+    }
+
+    // 未命中, 替换最久没有使用的页. 最后一页可能不满
+    uint64_t first = id * page_records_;
+    size_t n = size_t(std::min<uint64_t>(page_records_, nrecords_ - first));
+    in_->clear();
+    in_->seekg(std::streamoff(offset_ + first * record_));
+    if (!in_->read(victim->data.data(), std::streamsize(n * record_)))
+    {
+        victim->id = UINT64_MAX;
+        return nullptr;
+    }
+    victim->id = id;
+    victim->used = ++ clock_;
+    return victim->data.data() + (i % page_records_) * record_;
+}
+
+size_t MeshStream::Pages::bytes() const
+{
+    return pages_.size() * page_records_ * record_;
+}
+
+MeshStream::MeshStream(const char *filename, size_t memory_cap)
+    : failed_(false), cached_(false), chunk_faces_(0), faces_(0), peak_(0), nindices_(0), cursor_(0)
+{
+    memory_cap = std::max(memory_cap, MIN_MEMORY_CAP);
+    // 一半给一批三角形, 一半给读取缓冲和页缓存
+    chunk_faces_ = int(std::max<size_t>(1, memory_cap / 2 / (3 * sizeof(Vertex))));
+    size_t budget = memory_cap - size_t(chunk_faces_) * 3 * sizeof(Vertex);
+
+    cached_ = open_cache(filename, budget);
+    if (!cached_)
+        failed_ = !open_obj(filename, budget);
+}
+
+MeshStream::~MeshStream()
+{
+    for (int k = 0; k < 3; k ++)
+    {
+        spillFiles_[k].close();
+        if (!spill_[k].empty())
+        {
+            std::error_code ignore;
+            std::filesystem::remove(spill_[k], ignore);
+        }
+    }
+}
+
+bool MeshStream::open_cache(const char *filename, size_t budget)
+{
+    uint64_t stamp = meshcache::source_stamp(filename);
+    meshcache::Layout layout;
+    std::string path = std::string(filename) + ".meshcache";
+    if (!stamp || !meshcache::locate(path, stamp, layout))
+        return false;
+
+    ioBuffer_.assign(IO_BUFFER, 0);
+    cache_.rdbuf()->pubsetbuf(ioBuffer_.data(), std::streamsize(ioBuffer_.size()));
+    cache_.open(path, std::ios::binary);
+    if (!cache_)
+        return false;
+    budget -= std::min(budget, IO_BUFFER);
+    // 索引顺序读取, 一页就够; 其余都给顶点
+    size_t indexBudget = std::min(budget / 8, PAGE_RECORDS * sizeof(int));
+    indices_.open(&cache_, layout.index_offset, layout.nindices, sizeof(int), indexBudget);
+    vertices_.open(&cache_, layout.vertex_offset, layout.nvertices, sizeof(Vertex), budget - indices_.bytes());
+    nindices_ = layout.nindices;
+    return true;
+}
+
+bool MeshStream::open_obj(const char *filename, size_t budget)
+{
+    // 源文件和三个临时文件各一个读写缓冲
+    size_t nbuffers = 4;
+    budget -= std::min(budget, nbuffers * IO_BUFFER + LINE_BUFFER);
+    line_.reserve(LINE_BUFFER);
+    ioBuffer_.assign(nbuffers * IO_BUFFER, 0);
+    obj_.rdbuf()->pubsetbuf(ioBuffer_.data(), std::streamsize(IO_BUFFER));
+    obj_.open(filename, std::ifstream::in);
+    if (obj_.fail())
+        return false;
+
+    // 第一遍: 属性按 OBJ 里的顺序写成定长记录
+    auto tag = std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "-" +
+               std::to_string(reinterpret_cast<uintptr_t>(this));
+    std::error_code ec;
+    auto dir = std::filesystem::temp_directory_path(ec);
+    if (ec)
+        return false;
+    const char *names[3] = {"v", "vt", "vn"};
+    for (int k = 0; k < 3; k ++)
+    {
+        spill_[k] = (dir / ("tinyrenderer-" + tag + "-" + names[k] + ".bin")).string();
+        spillFiles_[k].rdbuf()->pubsetbuf(ioBuffer_.data() + (k + 1) * IO_BUFFER, std::streamsize(IO_BUFFER));
+        spillFiles_[k].open(spill_[k], std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!spillFiles_[k])
+            return false;
+    }
+
+    uint64_t counts[3] = {0, 0, 0};
+    while (std::getline(obj_, line_))
+    {
+        // 与 MeshAsset::load_obj 相同的行匹配
+        int k = !line_.compare(0, 2, "v ") ? 0 : !line_.compare(0, 4, "vt  ") ? 1 : !line_.compare(0, 4, "vn  ") ? 2 : -1;
+        if (k < 0)
+            continue;
+        std::istringstream iss(line_.c_str());
+        std::string strash;
+        iss >> strash;
+        float v[3] = {0.f, 0.f, 0.f};
+        for (size_t i = 0; i < ATTR_SIZE[k] / sizeof(float); i ++)
+            iss >> v[i];
+        spillFiles_[k].write(reinterpret_cast<const char *>(v), std::streamsize(ATTR_SIZE[k]));
+        counts[k] ++;
+    }
+    for (int k = 0; k < 3; k ++)
+    {
+        if (!spillFiles_[k].flush())
+            return false;
+        // 按属性每个记录的大小分配页缓存
+        attrs_[k].open(&spillFiles_[k], 0, counts[k], ATTR_SIZE[k], budget * ATTR_SIZE[k] / 32);
+    }
+
+    // 第二遍从头读面
+    obj_.clear();
+    obj_.seekg(0);
+    return true;
+}
+
+bool MeshStream::next(MeshChunk &chunk)
+{
+    chunk.vertices.clear();
+    if (failed_)
+        return false;
+    chunk.vertices.reserve(size_t(chunk_faces_) * 3);
+    bool more = cached_ ? next_cached(chunk) : next_obj(chunk);
+    track(chunk);
+    faces_ += chunk.nfaces();
+    return more && !failed_;
+}
+
+bool MeshStream::next_cached(MeshChunk &chunk)
+{
+    while (cursor_ < nindices_ && chunk.nfaces() < chunk_faces_)
+    {
+        for (int j = 0; j < 3; j ++, cursor_ ++)
+        {
+            const char *index = indices_.get(cursor_);
+            const char *vertex = nullptr;
+            if (index)
+            {
+                int i;
+                std::memcpy(&i, index, sizeof(i));
+                vertex = vertices_.get(uint32_t(i));
+            }
+            if (!vertex)
+            {
+                failed_ = true;
+                return false;
+            }
+            Vertex v;
+            std::memcpy(&v, vertex, sizeof(v));
+            chunk.vertices.push_back(v);
+        }
+    }
+    return chunk.nfaces() > 0;
+}
+
+bool MeshStream::next_obj(MeshChunk &chunk)
+{
+    while (chunk.nfaces() < chunk_faces_ && std::getline(obj_, line_))
+    {
+        if (line_.compare(0, 2, "f "))
+            continue;
+        std::istringstream iss(line_.c_str());
+        char trash;
+        iss >> trash;
+        int idx[3];
+        int corners = 0;
+        // 只取前三个顶点, 不足三个的面补成退化三角形, 与 MeshAsset::load_obj 一致
+        while (corners < 3 && iss >> idx[0] >> trash >> idx[1] >> trash >> idx[2])
+        {
+            const char *attr[3];
+            for (int k = 0; k < 3; k ++)
+                if (!(attr[k] = attrs_[k].get(uint64_t(int64_t(idx[k]) - 1))))
+                {
+                    failed_ = true;
+                    return false;
+                }
+            Vertex v;
+            std::memcpy(&v.pos, attr[0], sizeof(v.pos));
+            std::memcpy(&v.uv, attr[1], sizeof(v.uv));
+            std::memcpy(&v.normal, attr[2], sizeof(v.normal));
+            chunk.vertices.push_back(v);
+            corners ++;
+        }
+        for (; corners > 0 && corners < 3; corners ++)
+            chunk.vertices.push_back(chunk.vertices.back());
+    }
+    return chunk.nfaces() > 0;
+}
+
+void MeshStream::track(const MeshChunk &chunk)
+{
+    size_t bytes = chunk.vertices.capacity() * sizeof(Vertex) + ioBuffer_.size() + line_.capacity();
+    bytes += vertices_.bytes() + indices_.bytes();
+    for (const Pages &p : attrs_)
+        bytes += p.bytes();
+    peak_ = std::max(peak_, bytes);
+    memory_.set(bytes);
+}
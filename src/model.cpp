@@ -1,153 +1,176 @@
-#include <iostream>
-#include <string>
-#include <fstream>
-#include <sstream>
+#include <algorithm>
 #include <vector>
 #include "model.h"
 
 // ------------------- Model Class ------------------- //
 
-Model::Model(const char *filename) : verts_(), faces_(), normals_()
+Model::Model(const char *filename, Texture::Layout layout, bool compress, bool optimize, AssetManager *assets,
+             bool geometry)
+    : layout_(layout), compress_(compress), useMaterial(false), hasViewNormals(false)
+{
+    AssetManager &am = assets ? *assets : AssetManager::shared();
+
+    // 网格和三张贴图互不依赖, 同时交给线程池加载, 等待时间取决于最大的那个
+    MaterialPaths paths = resolve_material(filename);
+    AssetManager::Handle<MeshAsset> mesh;
+    if (geometry)
+        mesh = am.mesh(filename, optimize);
+    auto diffuse  = am.texture(paths.diffuse, layout_, compress_ ? Texture::BC1 : Texture::UNCOMPRESSED,
+                               memstats::DIFFUSE_MAP);
+    auto specular = am.texture(paths.specular, layout_, compress_ ? Texture::BC4 : Texture::UNCOMPRESSED,
+                               memstats::SPECULAR_MAP);
+    // 未压缩时 prepare_view_normals 再从中生成变换好的法线, 压缩模式为了省内存只保留 BC5 贴图
+    auto normal   = am.texture(paths.normal, layout_, compress_ ? Texture::BC5 : Texture::UNCOMPRESSED,
+                               memstats::NORMAL_MAP);
+
+    mesh_        = geometry ? mesh.get() : nullptr;
+    textureMap   = diffuse.get();
+    specularMap  = specular.get();
+    normalMap    = normal.get();
+    if (!mesh_)
+        mesh_ = std::make_shared<const MeshAsset>();
+}
+
+Model::~Model()
 {
-    std::ifstream in;
-    in.open(filename, std::ifstream::in);
-    if (in.fail())
-        return;
-    std::string line;
-    while (!in.eof())
-    {
-        std::getline(in, line);
-        std::istringstream iss(line.c_str());
-        char trash;
-        int itrash;
-        std::string strash;
-        if (!line.compare(0, 2, "v "))
-        {
-            iss >> trash;
-            Vec3f v;
-            for (int i = 0; i < 3; i++)
-                iss >> v[i];
-            verts_.push_back(v);
-        }
-        else if (!line.compare(0, 2, "f "))
-        {
-            std::vector<Vec3i> f;
-            iss >> trash;
-            int idx, vtidx, nidx;
-            vector<Vec3f> nVerts;
-            vector<Vec3f> nNorms;
-            vector<Vec2f> nTextures;
-            while (iss >> idx >> trash >> vtidx >> trash >> nidx)
-            {
-                idx --; // in wavefront obj all indices start at 1, not zero
-                vtidx --;
-                nidx --;
-                nVerts.push_back(verts_[idx]);
-                nTextures.push_back(textures_[vtidx]);
-                nNorms.push_back(normals_[nidx]);
-            }
-
-            faces_.push_back(Trangle(nVerts, nNorms, nTextures));
-        }
-        else if (!line.compare(0, 4, "vt  "))
-        {
-            iss >> strash;
-            Vec2f t;
-            for (int i = 0; i < 2; i++)
-                iss >> t[i];
-            textures_.push_back(t);
-        }
-        else if (!line.compare(0, 4, "vn  "))
-        {
-            iss >> strash;
-            Vec3f t;
-            for (int i = 0; i < 3; i ++)
-                iss >> t[i];
-            normals_.push_back(t);
-        }
-    }
-    std::cerr << "# v# " << verts_.size() << std::endl;
-    std::cerr << "# f# " << faces_.size() << std::endl;
-    std::cerr << "# vt# " << textures_.size() << std::endl;
-    std::cerr << "# vn# " << normals_.size() << std::endl;
+}
+
+int Model::nlods() const
+{
+    return int(mesh_->lods.size());
+}
 
-    load_texture("/home/feng/Code/tinyRenderer/data/african_head_diffuse.tga", this->textureMap);
-    load_texture("/home/feng/Code/tinyRenderer/data/african_head_spec.tga", this->specularMap);
-    load_texture("/home/feng/Code/tinyRenderer/data/african_head_nm.tga", this->normalMap);
+const Mesh &Model::lod(int level) const
+{
+    // 网格加载失败时一级也没有, 当作空网格
+    static const Mesh empty;
+    if (mesh_->lods.empty())
+        return empty;
+    return mesh_->lods[std::max(0, std::min(level, nlods() - 1))];
 }
 
-Model::~Model()
+int Model::select_lod(float pixels_per_unit) const
 {
+    int level = 0;
+    while (level + 1 < nlods() && mesh_->lods[level + 1].error * pixels_per_unit <= LOD_PIXEL_ERROR)
+        level ++;
+    return level;
 }
 
 int Model::nverts()
 {
-    return (int)verts_.size();
+    return mesh_->counts.nverts;
 }
 
 int Model::nfaces()
 {
-    return (int)faces_.size();
+    return mesh_->lods.empty() ? 0 : mesh_->lods[0].nfaces();
 }
 
 int Model::ntextures()
 {
-    return (int)textures_.size();
+    return mesh_->counts.ntextures;
 }
 
 Trangle Model::face(int idx)
 {
-    return faces_[idx];
+    vector<Vec3f> nVerts, nNorms;
+    vector<Vec2f> nTextures;
+    for (int i = 0; i < 3; i ++)
+    {
+        const Vertex &v = mesh_->vertices[mesh_->lods[0].indices[idx * 3 + i]];
+        nVerts.push_back(v.pos);
+        nNorms.push_back(v.normal);
+        nTextures.push_back(v.uv);
+    }
+    return Trangle(nVerts, nNorms, nTextures);
 }
 
 // 获取顶点坐标, 参数为三角形编号和顶点编号
 Vec3f Model::vert(int iface, int ivert)
 {
-    return faces_[iface].nVert(ivert);
+    return mesh_->vertices[mesh_->lods[0].indices[iface * 3 + ivert]].pos;
 }
 
 // 获取法线向量, 参数为三角形编号和顶点编号(从obj文件中读到的法线坐标)
 Vec3f Model::normal(int iface, int ivert)
 {
-    return faces_[iface].nNorm(ivert);
+    return mesh_->vertices[mesh_->lods[0].indices[iface * 3 + ivert]].normal;
 }
 
 // 获取法线向量(从法线贴图获取)
 Vec3f Model::normal(Vec2f& uvf)
 {
-    TGAColor c = normalMap.get(uvf[0] * normalMap.getWidth(), uvf[1] * normalMap.getHeight());
+    TGAColor c = normalMap->sample(uvf);
     // 切线方向范围为 (-1, 1)映射到了(0, 255), 要将它映射回来
     return Vec3f{(float)c[2], (float)c[1], (float)c[0]} * 2.f / 255.f - Vec3f{1, 1, 1};
 }
 
-// 获取纹理坐标, 参数为三角形编号和顶点编号
-Vec2f Model::texture(int iface, int ivert)
+void Model::prepare_view_normals(const Matrix4f &mit)
+{
+    bool same = hasViewNormals;
+    for (int i = 0; same && i < 4; i ++)
+        for (int j = 0; same && j < 4; j ++)
+            same = viewNormalsMatrix[i][j] == mit[i][j];
+    if (same)
+        return;
+
+    // 压缩模式下不展开 BC5 贴图, view_normal 逐个片段解码和变换
+    if (!compress_)
+        viewNormals = NormalMap(*normalMap, mit);
+    viewNormalsMatrix = mit;
+    hasViewNormals = true;
+    materialMap = MaterialMap();
+    set_material(useMaterial);
+}
+
+void Model::set_material(bool enable)
+{
+    useMaterial = enable;
+    if (!enable)
+        materialMap = MaterialMap();
+    else if (hasViewNormals && materialMap.empty() && !compress_ &&
+             MaterialMap::compatible(*textureMap, *specularMap, viewNormals))
+        materialMap = MaterialMap(*textureMap, *specularMap, viewNormals);
+}
+
+Vec3f Model::view_normal(Vec2f uvf)
+{
+    if (!compress_)
+        return viewNormals.sample(uvf);
+    // 与 NormalMap 构造时相同: 先归一化, 变换后再归一化
+    Vec3f n = normal(uvf);
+    n = proj<3>(viewNormalsMatrix * embed<4>(n.normalize()));
+    return n.normalize();
+}
+
+bool Model::has_material()
 {
-    return faces_[iface].nTexture(ivert);
+    return !materialMap.empty();
 }
 
+const MaterialTexel &Model::material(Vec2f uvf)
+{
+    return materialMap.sample(uvf);
+}
 
-void Model::load_texture(std::string filename, TGAImage& img)
+// 获取纹理坐标, 参数为三角形编号和顶点编号
+Vec2f Model::texture(int iface, int ivert)
 {
-    bool status = img.read_tga_file(filename.c_str());
-    std::cout << "load " << filename << " status: "
-              << (status ? "ok" : "failed") << std::endl;
-    img.flip_vertically();
+    return mesh_->vertices[mesh_->lods[0].indices[iface * 3 + ivert]].uv;
 }
 
 
 // 获取纹理, 参数为纹理坐标
 TGAColor Model::getTexture(Vec2f uv)
 {
-    return this->textureMap.get(
-        uv[0] * this->textureMap.get_width(),
-        uv[1] * this->textureMap.get_height());
+    return textureMap->sample(uv);
 }
 
 
 int Model::nnormals()
 {
-    return int(normals_.size());
+    return mesh_->counts.nnormals;
 }
 
 // --------------------  Trangle Class -------------------- //
@@ -204,6 +227,5 @@ Vec2f Trangle::nTexture(int idx)
 // 从镜面反射贴图中获取镜面反射分;量
 float Model::specular(Vec2f uvf)
 {
-    Vec2i uv(uvf[0]*specularMap.get_width(), uvf[1]*specularMap.get_height());
-    return specularMap.get(uv[0], uv[1])[0]/1.f;
+    return specularMap->sample(uvf)[0]/1.f;
 }
\ No newline at end of file
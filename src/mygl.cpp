@@ -1,24 +1,13 @@
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
 #include "mygl.h"
 
-Matrix4f mygl::modelView;
-Matrix4f mygl::viewport;
-Matrix4f mygl::projection;
-
-// 求点P相对于三角形ABC的重心坐标
-static Vec3f barycentric(Vec2f A, Vec2f B, Vec2f C, Vec2f P)
-{
-    Vec3f u = Vec3f(C[0] - A[0], B[0] - A[0], A[0] - P[0]) ^
-              Vec3f(C[1] - A[1], B[1] - A[1], A[1] - P[1]);
-
-    if (std::abs(u[2]) > 1e-2) // u[2] 是整数. If it is zero then triangle ABC is degenerate
-        return Vec3f(1.f - (u.x + u.y) / u.z, u.y / u.z, u.x / u.z);
-    return Vec3f(-1, 1, 1);
-}
-
 // 视口变换矩阵, 将点变换到二维屏幕上
-void mygl::viewportMatrix(int x, int y, int w, int h)
+void mygl::viewportMatrix(View &view, int x, int y, int w, int h)
 {
+    Matrix4f &viewport = view.viewport;
     viewport = Matrix4f::identity();
     viewport[0][3] = x + w / 2.f;
     viewport[1][3] = y + h / 2.f;
@@ -30,14 +19,14 @@ void mygl::viewportMatrix(int x, int y, int w, int h)
 }
 
 // 透视投影矩阵
-void mygl::projectionMatrix(float coeff)
+void mygl::projectionMatrix(View &view, float coeff)
 {
-    projection = Matrix4f::identity();
-    projection[3][2] = coeff;
+    view.projection = Matrix4f::identity();
+    view.projection[3][2] = coeff;
 }
 
 // 视图变换矩阵, 将世界坐标系的点转换成相机坐标系的点
-void mygl::viewMatrix(Vec3f cameraPos, Vec3f lookPos, Vec3f upDir)
+void mygl::viewMatrix(View &view, Vec3f cameraPos, Vec3f lookPos, Vec3f upDir)
 {
     cameraPos.normalize();
     // 右手系
@@ -45,6 +34,7 @@ void mygl::viewMatrix(Vec3f cameraPos, Vec3f lookPos, Vec3f upDir)
     Vec3f x = (upDir ^ z).normalize();
     Vec3f y = (z ^ x).normalize();
 
+    Matrix4f &modelView = view.modelView;
     modelView = Matrix4f::identity();
     for (int i = 0; i < 3; i ++)
     {
@@ -55,54 +45,339 @@ void mygl::viewMatrix(Vec3f cameraPos, Vec3f lookPos, Vec3f upDir)
     }
 }
 
-
-void mygl::triangle(Vec4f *pts, IShader &shader, TGAImage &image, TGAImage &zbuffer)
+void mygl::triangle(Vec4f *pts, IShader &shader, Framebuffer &fb, const Rect *scissor)
 {
+    // 没有近平面裁剪, 有顶点在相机平面之后的三角形直接丢弃, w 为 NaN 的也一样
+    if (!(pts[0][3] > 0) || !(pts[1][3] > 0) || !(pts[2][3] > 0))
+        return;
+
+    // 屏幕坐标和 1/w, 不是有限值的 (退化的视图) 丢弃, 否则包围盒转成整数时越界
+    Vec2f s[3];
+    float rw[3];
+    for (int i = 0; i < 3; i ++)
+    {
+        rw[i] = 1.f / pts[i][3];
+        s[i]  = Vec2f(pts[i][0] * rw[i], pts[i][1] * rw[i]);
+        if (!std::isfinite(s[i].x) || !std::isfinite(s[i].y) || !std::isfinite(rw[i]))
+            return;
+    }
+
+    float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[1].y - s[0].y) * (s[2].x - s[0].x);
+    if (std::abs(area) < 1e-2f) // 退化三角形
+        return;
+
+    // 平面方程: 0-2 为屏幕空间重心坐标, 3 为 z/w, 4 为 1/w, 之后为 varying/w
+    enum { Z = 3, INV_W = 4, ATTR = 5 };
+    const int nplanes = ATTR + shader.nvaryings;
+    Plane planes[ATTR + MAX_VARYINGS];
+    for (int i = 0; i < 3; i ++)
+    {
+        const Vec2f &b = s[(i + 1) % 3], &c = s[(i + 2) % 3];
+        planes[i] = Plane{(b.y - c.y) / area, (c.x - b.x) / area, (b.x * c.y - b.y * c.x) / area};
+    }
+    // 顶点上的值 f[i] 在屏幕空间线性插值
+    auto lerpPlane = [&planes](const float f[3])
+    {
+        Plane p{0.f, 0.f, 0.f};
+        for (int i = 0; i < 3; i ++)
+        {
+            p.dx += planes[i].dx * f[i];
+            p.dy += planes[i].dy * f[i];
+            p.c  += planes[i].c  * f[i];
+        }
+        return p;
+    };
+    float zw[3] = {pts[0][2] * rw[0], pts[1][2] * rw[1], pts[2][2] * rw[2]};
+    planes[Z]     = lerpPlane(zw);
+    planes[INV_W] = lerpPlane(rw);
+    for (int k = 0; k < shader.nvaryings; k ++)
+    {
+        float f[3] = {shader.varying[0][k] * rw[0], shader.varying[1][k] * rw[1], shader.varying[2][k] * rw[2]};
+        planes[ATTR + k] = lerpPlane(f);
+    }
+
     Vec2f bboxmin(std::numeric_limits<float>::max(),
                   std::numeric_limits<float>::max());
     Vec2f bboxmax(-std::numeric_limits<float>::max(),
                   -std::numeric_limits<float>::max());
-
     for (int i = 0; i < 3; i ++)
     {
         for (int j = 0; j < 2; j ++)
         {
-            bboxmin[j] = std::min(bboxmin[j], pts[i][j] / pts[i][3]);
-            bboxmax[j] = std::max(bboxmax[j], pts[i][j] / pts[i][3]);
+            bboxmin[j] = std::min(bboxmin[j], s[i][j]);
+            bboxmax[j] = std::max(bboxmax[j], s[i][j]);
         }
     }
 
-    Vec2i P;
+    // 多重采样时采样点偏离像素中心不到半个像素, 包围盒和整块判定都向外扩半个像素
+    const int nsamples = fb.samples();
+    const float pad = nsamples > 1 ? 0.5f : 0.f;
+
+    // 包围盒裁剪到图像范围内, 之后的像素访问不再需要边界检查. 完全在图像外的先丢弃, 免得很大的坐标转成整数时溢出
+    if (bboxmax.x + pad < 0.f || bboxmax.y + pad < 0.f || bboxmin.x - pad > float(fb.width() - 1) ||
+        bboxmin.y - pad > float(fb.height() - 1))
+        return;
+    int xmin = std::max(bboxmin.x - pad, 0.f);
+    int ymin = std::max(bboxmin.y - pad, 0.f);
+    int xmax = std::floor(std::min(bboxmax.x + pad, float(fb.width() - 1)));
+    int ymax = std::floor(std::min(bboxmax.y + pad, float(fb.height() - 1)));
+    // 是否分块判定只看裁剪到帧缓冲的包围盒, 与 scissor 无关, 分条或分块重画时每个像素的结果与整帧光栅化相同
+    const int B = RASTER_BLOCK;
+    const bool hierarchical = (xmax - xmin + 1) * (ymax - ymin + 1) > 4 * B * B;
+    if (scissor)
+    {
+        xmin = std::max(xmin, scissor->x0);
+        ymin = std::max(ymin, scissor->y0);
+        xmax = std::min(xmax, scissor->x1);
+        ymax = std::min(ymax, scissor->y1);
+    }
+
+    Fragment frag;
+    frag.attr  = planes + ATTR;
+    frag.inv_w = planes + INV_W;
+
+    // 由平面方程在某点的值 at 求片段着色器的输入, 每个片段一次倒数
+    auto interpolate = [&](const float *at)
+    {
+        frag.w = 1.f / at[INV_W];
+        for (int i = 0; i < 3; i ++)
+            frag.bar[i] = at[i] * rw[i] * frag.w;
+        for (int k = 0; k < shader.nvaryings; k ++)
+            frag.varying[k] = at[ATTR + k] * frag.w;
+    };
+
+    // 矩形内的像素, full 为 true 时矩形完全在三角形内, 不做覆盖测试
     TGAColor color;
-    int cnt = 10;
-    for (P.x = bboxmin.x; P.x <= bboxmax.x; P.x ++)
+    float v[ATTR + MAX_VARYINGS];
+    auto shadeBlock = [&](int x0, int y0, int x1, int y1, auto full)
     {
-        for (P.y = bboxmin.y; P.y <= bboxmax.y; P.y ++)
+        for (int y = y0; y <= y1; y ++)
         {
-            Vec3f c = barycentric(proj<2>(pts[0] / pts[0][3]),
-                                  proj<2>(pts[1] / pts[1][3]),
-                                  proj<2>(pts[2] / pts[2][3]),
-                                  proj<2>(P));
+            // 每行起点求一次平面方程, 行内逐像素累加
+            for (int k = 0; k < nplanes; k ++)
+                v[k] = planes[k].at(x0, y);
 
-            if (c.x < 0 || c.y < 0 || c.z < 0) continue;
+            for (int x = x0; x <= x1; x ++)
+            {
+                bool inside = decltype(full)::value || (v[0] >= 0 && v[1] >= 0 && v[2] >= 0);
+                int frag_depth = std::max(0, std::min(255, int(v[Z] + 0.5f)));
+                unsigned char *zpixel = fb.depth(x, y);
+                if (inside && *zpixel <= frag_depth)
+                {
+                    interpolate(v);
+                    if (!shader.fragment(frag, color))
+                    {
+                        *zpixel = frag_depth;
+                        Image<RGB8>::encode(fb.color(x, y), color);
+                    }
+                }
+                for (int k = 0; k < nplanes; k ++)
+                    v[k] += planes[k].dx;
+            }
+        }
+    };
+
+    // 各采样点相对像素中心的三条边和 z 的增量, 单采样时唯一的采样点就是像素中心
+    static const float PIXEL_CENTER[1][2] = {{0.f, 0.f}};
+    const float (*positions)[2] = nsamples > 1 ? MSAA_POSITIONS : PIXEL_CENTER;
+    float edge_offset[3][Framebuffer::MAX_SAMPLES], z_offset[Framebuffer::MAX_SAMPLES];
+    for (int s = 0; s < nsamples; s ++)
+    {
+        for (int i = 0; i < 3; i ++)
+            edge_offset[i][s] = planes[i].dx * positions[s][0] + planes[i].dy * positions[s][1];
+        z_offset[s] = planes[Z].dx * positions[s][0] + planes[Z].dy * positions[s][1];
+    }
+
+    // 多重采样: 逐采样点测试覆盖和深度, 有采样点通过时着色一次, 颜色写入通过的采样点.
+    // 像素中心不在三角形内时改在第一个覆盖的采样点上插值, 避免 varying 外插到三角形之外
+    float vs[ATTR + MAX_VARYINGS];
+    auto shadeBlockSamples = [&](int x0, int y0, int x1, int y1, auto full)
+    {
+        for (int y = y0; y <= y1; y ++)
+        {
+            for (int k = 0; k < nplanes; k ++)
+                v[k] = planes[k].at(x0, y);
+
+            for (int x = x0; x <= x1; x ++)
+            {
+                unsigned char *zs = fb.depth(x, y);
+                int sample_depth[Framebuffer::MAX_SAMPLES];
+                unsigned covered = 0, mask = 0;
+                for (int s = 0; s < nsamples; s ++)
+                {
+                    bool inside = decltype(full)::value ||
+                                  (v[0] + edge_offset[0][s] >= 0 && v[1] + edge_offset[1][s] >= 0 &&
+                                   v[2] + edge_offset[2][s] >= 0);
+                    sample_depth[s] = std::max(0, std::min(255, int(v[Z] + z_offset[s] + 0.5f)));
+                    covered |= unsigned(inside) << s;
+                    mask |= unsigned(inside && zs[s] <= sample_depth[s]) << s;
+                }
+                if (mask)
+                {
+                    const float *at = v;
+                    if (!decltype(full)::value && !(v[0] >= 0 && v[1] >= 0 && v[2] >= 0))
+                    {
+                        int s = 0;
+                        while (!(covered & (1u << s)))
+                            s ++;
+                        for (int k = 0; k < nplanes; k ++)
+                            vs[k] = v[k] + planes[k].dx * MSAA_POSITIONS[s][0] + planes[k].dy * MSAA_POSITIONS[s][1];
+                        at = vs;
+                    }
+                    interpolate(at);
+                    if (!shader.fragment(frag, color))
+                    {
+                        for (int s = 0; s < nsamples; s ++)
+                            if (mask & (1u << s))
+                                zs[s] = sample_depth[s];
+                        fb.store(x, y, mask, color);
+                    }
+                }
+                for (int k = 0; k < nplanes; k ++)
+                    v[k] += planes[k].dx;
+            }
+        }
+    };
 
-            // 插值计算z坐标: z坐标插值 / 齐次坐标插值
-            float z = 0.f;
-            float w = 0.f;
-            for (int i = 0; i < 3; i ++)
+    // 可变着色率: 覆盖和深度仍然逐像素 (逐采样点) 测试, 对齐到 rate 整数倍的 rate x rate 像素块内有像素通过时
+    // 在块中心着色一次, 颜色广播到块内通过的像素. 块中心不在三角形内时改在第一个覆盖的采样点上插值
+    auto shadeBlockCoarse = [&](int x0, int y0, int x1, int y1, int rate, auto full)
+    {
+        unsigned masks[4 * 4];
+        int depths[4 * 4][Framebuffer::MAX_SAMPLES];
+        for (int qy = y0 / rate * rate; qy <= y1; qy += rate)
+        {
+            for (int qx = x0 / rate * rate; qx <= x1; qx += rate)
             {
-                z += pts[i][2] * c[i];
-                w += pts[i][3] * c[i];
+                int cx0 = std::max(qx, x0), cx1 = std::min(qx + rate - 1, x1);
+                int cy0 = std::max(qy, y0), cy1 = std::min(qy + rate - 1, y1);
+                unsigned any = 0;
+                bool found = false;
+                float fx = 0.f, fy = 0.f;
+                for (int y = cy0; y <= cy1; y ++)
+                {
+                    for (int x = cx0; x <= cx1; x ++)
+                    {
+                        float e0 = planes[0].at(x, y), e1 = planes[1].at(x, y), e2 = planes[2].at(x, y);
+                        float z = planes[Z].at(x, y);
+                        const unsigned char *zs = fb.depth(x, y);
+                        int *sample_depth = depths[(y - qy) * rate + x - qx];
+                        unsigned mask = 0;
+                        for (int s = 0; s < nsamples; s ++)
+                        {
+                            bool inside = decltype(full)::value ||
+                                          (e0 + edge_offset[0][s] >= 0 && e1 + edge_offset[1][s] >= 0 &&
+                                           e2 + edge_offset[2][s] >= 0);
+                            sample_depth[s] = std::max(0, std::min(255, int(z + z_offset[s] + 0.5f)));
+                            if (inside && !found)
+                            {
+                                found = true;
+                                fx = x + positions[s][0];
+                                fy = y + positions[s][1];
+                            }
+                            mask |= unsigned(inside && zs[s] <= sample_depth[s]) << s;
+                        }
+                        masks[(y - qy) * rate + x - qx] = mask;
+                        any |= mask;
+                    }
+                }
+                if (!any)
+                    continue;
+
+                float sx = qx + (rate - 1) * 0.5f, sy = qy + (rate - 1) * 0.5f;
+                if (!decltype(full)::value &&
+                    !(planes[0].at(sx, sy) >= 0 && planes[1].at(sx, sy) >= 0 && planes[2].at(sx, sy) >= 0))
+                {
+                    sx = fx;
+                    sy = fy;
+                }
+                for (int k = 0; k < nplanes; k ++)
+                    vs[k] = planes[k].at(sx, sy);
+                interpolate(vs);
+                if (shader.fragment(frag, color))
+                    continue;
+
+                for (int y = cy0; y <= cy1; y ++)
+                {
+                    for (int x = cx0; x <= cx1; x ++)
+                    {
+                        unsigned mask = masks[(y - qy) * rate + x - qx];
+                        if (!mask)
+                            continue;
+                        unsigned char *zs = fb.depth(x, y);
+                        const int *sample_depth = depths[(y - qy) * rate + x - qx];
+                        for (int s = 0; s < nsamples; s ++)
+                            if (mask & (1u << s))
+                                zs[s] = sample_depth[s];
+                        if (nsamples > 1)
+                            fb.store(x, y, mask, color);
+                        else
+                            Image<RGB8>::encode(fb.color(x, y), color);
+                    }
+                }
             }
+        }
+    };
 
-            int frag_depth = std::max(0, std::min(255, int(z / w + 0.5f)));
-            if (zbuffer.get(P.x, P.y)[0] > frag_depth) continue;
+    auto shade = [&](int x0, int y0, int x1, int y1, int rate, auto full)
+    {
+        if (rate > 1)
+            shadeBlockCoarse(x0, y0, x1, y1, rate, full);
+        else if (nsamples > 1)
+            shadeBlockSamples(x0, y0, x1, y1, full);
+        else
+            shadeBlock(x0, y0, x1, y1, full);
+    };
 
-            bool discard = shader.fragment(c, color);
-            if (!discard)
+    // 按光栅化分块遍历包围盒, 分块布局下一个分块内的访问落在连续内存中.
+    // 分块内再按 8x8 块在四个角点求三条边的值 (边函数是线性的, 极值在角点上):
+    // 有一条边在四个角点都为负时整块跳过, 三条边在四个角点都非负时整块不做逐像素的覆盖测试.
+    // 判定留有与平面系数量级成比例的余量, 逐像素累加的舍入误差不会让快速路径的结果与逐像素测试不同.
+    // 包围盒不超过 2x2 个块的小三角形分类得不偿失, 直接按分块逐像素测试.
+    const int T = Framebuffer::TILE;
+    // 着色率取这次绘制的和分块的之中较粗的一个, 限定为 1, 2 或 4, 像素块不会跨过 8x8 块
+    const int draw_rate = shader.shading_rate;
+    for (int ty = ymin / T * T; ty <= ymax; ty += T)
+    {
+        for (int tx = xmin / T * T; tx <= xmax; tx += T)
+        {
+            int rate = std::max(draw_rate, fb.shading_rate(tx, ty));
+            rate = rate >= 4 ? 4 : rate >= 2 ? 2 : 1;
+            if (!hierarchical)
             {
-                zbuffer.set(P.x, P.y, TGAColor(frag_depth));
-                image.set(P.x, P.y, color);
+                shade(std::max(tx, xmin), std::max(ty, ymin), std::min(tx + T - 1, xmax), std::min(ty + T - 1, ymax),
+                      rate, std::false_type());
+                continue;
+            }
+            for (int by = ty; by < ty + T; by += B)
+            {
+                for (int bx = tx; bx < tx + T; bx += B)
+                {
+                    int y0 = std::max(by, ymin), y1 = std::min(by + B - 1, ymax);
+                    int x0 = std::max(bx, xmin), x1 = std::min(bx + B - 1, xmax);
+                    if (x0 > x1 || y0 > y1)
+                        continue;
+
+                    bool outside = false, full = true;
+                    for (int i = 0; i < 3 && !outside; i ++)
+                    {
+                        const Plane &p = planes[i];
+                        float e00 = p.at(x0 - pad, y0 - pad), e10 = p.at(x1 + pad, y0 - pad);
+                        float e01 = p.at(x0 - pad, y1 + pad), e11 = p.at(x1 + pad, y1 + pad);
+                        float lo = std::min(std::min(e00, e10), std::min(e01, e11));
+                        float hi = std::max(std::max(e00, e10), std::max(e01, e11));
+                        float margin = 64 * std::numeric_limits<float>::epsilon() *
+                                       (std::abs(p.dx) * (x1 + pad) + std::abs(p.dy) * (y1 + pad) + std::abs(p.c));
+                        outside = hi < -margin;
+                        full = full && lo >= margin;
+                    }
+                    if (outside)
+                        continue;
+                    if (full)
+                        shade(x0, y0, x1, y1, rate, std::true_type());
+                    else
+                        shade(x0, y0, x1, y1, rate, std::false_type());
+                }
             }
         }
     }
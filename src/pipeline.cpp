@@ -0,0 +1,480 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include "imageops.h"
+#include "meshstream.h"
+#include "pipeline.h"
+
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+const mygl::Rect NO_TILES{0, 0, -1, -1};
+
+// 实例包围球的外接立方体在屏幕上覆盖的分块范围, 四周各多留一个像素 (多重采样向外扩的半个像素和取整).
+// 有角点在相机平面之后时当作覆盖整个屏幕
+mygl::Rect screenTiles(const Matrix4f &vp, const Scene::Instance &inst, int width, int height)
+{
+    const int T = mygl::Framebuffer::TILE;
+    float lo[2] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    float hi[2] = {-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+    for (int c = 0; c < 8; c ++)
+    {
+        Vec3f corner(inst.center.x + (c & 1 ? inst.radius : -inst.radius),
+                     inst.center.y + (c & 2 ? inst.radius : -inst.radius),
+                     inst.center.z + (c & 4 ? inst.radius : -inst.radius));
+        Vec4f p = vp * embed<4>(corner, 1.f);
+        if (!(p[3] > 0))
+            return mygl::Rect{0, 0, (width - 1) / T, (height - 1) / T};
+        for (int k = 0; k < 2; k ++)
+        {
+            float v = p[k] / p[3];
+            if (!std::isfinite(v))
+                return mygl::Rect{0, 0, (width - 1) / T, (height - 1) / T};
+            lo[k] = std::min(lo[k], v);
+            hi[k] = std::max(hi[k], v);
+        }
+    }
+    int x0 = std::max(0, int(std::floor(lo[0])) - 1), x1 = std::min(width - 1, int(std::floor(hi[0])) + 1);
+    int y0 = std::max(0, int(std::floor(lo[1])) - 1), y1 = std::min(height - 1, int(std::floor(hi[1])) + 1);
+    if (x0 > x1 || y0 > y1)
+        return NO_TILES;
+    return mygl::Rect{x0 / T, y0 / T, x1 / T, y1 / T};
+}
+
+bool sameCamera(const Camera &a, const Camera &b)
+{
+    for (int k = 0; k < 3; k ++)
+        if (a.eye[k] != b.eye[k] || a.center[k] != b.center[k] || a.up[k] != b.up[k])
+            return false;
+    return true;
+}
+
+bool sameTransform(const Matrix4f &a, const Matrix4f &b)
+{
+    for (int i = 0; i < 4; i ++)
+        for (int j = 0; j < 4; j ++)
+            if (a[i][j] != b[i][j])
+                return false;
+    return true;
+}
+}
+
+FramePipeline::FramePipeline(Scene &scene, int width, int height, size_t frames_in_flight,
+                             mygl::Scheduler &scheduler, int samples)
+    : scene_(scene), width_(width), height_(height), scheduler_(scheduler), frames_(0), failures_(0), shading_rate_(1),
+      adaptive_threshold_(0.f), incremental_(false), verbose_(false), budget_ms_(0), min_scale_(1.f), scale_(1.f), stream_cap_(0), stream_model_(-1)
+{
+    // 每个线程一条, 条的边界对齐到帧缓冲的分块
+    const int T = mygl::Framebuffer::TILE;
+    int nthreads = int(std::max<size_t>(1, scheduler.nthreads()));
+    band_ = ((height + nthreads - 1) / nthreads + T - 1) / T * T;
+    nbands_ = (height + band_ - 1) / band_;
+
+    for (size_t i = 0; i < std::max<size_t>(1, frames_in_flight); i ++)
+    {
+        auto slot = std::make_unique<Slot>();
+        slot->width   = width;
+        slot->height  = height;
+        slot->band_ms.resize(nbands_);
+        slot->fb      = mygl::Framebuffer(width, height, mygl::Framebuffer::TILED, samples);
+        slot->image   = TGAImage(width, height, TGAImage::RGB);
+        slot->zbuffer = TGAImage(width, height, TGAImage::GRAYSCALE);
+        slot->bins.resize(nbands_);
+        slot->rects.resize(nbands_);
+        for (int b = 0; b < nbands_; b ++)
+            slot->band_jobs.push_back(BandJob{slot.get(), b});
+        slots_.push_back(std::move(slot));
+    }
+    geometry_task_.resize(1);
+    band_tasks_.resize(nbands_);
+    // 每个在途帧一个几何, nbands_ 个光栅化和一个输出任务, 几何任务的后继最多
+    scheduler_.reserve(slots_.size() * (nbands_ + 2), nbands_);
+}
+
+FramePipeline::~FramePipeline()
+{
+    flush();
+}
+
+void FramePipeline::set_stream(const char *filename, size_t memory_cap, int model)
+{
+    stream_file_  = filename;
+    stream_cap_   = memory_cap;
+    stream_model_ = model;
+}
+
+void FramePipeline::set_frame_budget(double budget_ms, float min_scale)
+{
+    std::lock_guard<std::mutex> lock(times_mutex_);
+    budget_ms_ = budget_ms;
+    min_scale_ = std::min(1.f, std::max(0.05f, min_scale));
+}
+
+void FramePipeline::submit(const Camera &camera, const std::string &image_path, const std::string &zbuffer_path)
+{
+    Slot &slot = *slots_[frames_ % slots_.size()];
+    if (slot.busy)
+        scheduler_.wait(slot.done);
+    slot.index        = frames_ ++;
+    slot.camera       = camera;
+    slot.scene        = scene_;
+    slot.image_path   = image_path;
+    slot.zbuffer_path = zbuffer_path;
+
+    Slot *s = &slot;
+    geometry_task_[0] = scheduler_.add([this, s] { geometry(*s); });
+    for (int b = 0; b < nbands_; b ++)
+    {
+        const BandJob *job = &slot.band_jobs[b];
+        band_tasks_[b] = scheduler_.add([this, job] { raster(*job->slot, job->band); }, geometry_task_);
+    }
+    slot.done = scheduler_.add([this, s] { output(*s); }, band_tasks_);
+    slot.busy = true;
+}
+
+void FramePipeline::flush()
+{
+    for (auto &slot : slots_)
+    {
+        if (slot->busy)
+            scheduler_.wait(slot->done);
+        slot->busy = false;
+    }
+}
+
+size_t FramePipeline::arena_capacity() const
+{
+    size_t n = 0;
+    for (const auto &slot : slots_)
+        n += slot->arena.capacity();
+    return n;
+}
+
+void FramePipeline::resize(Slot &slot)
+{
+    float scale = 1.f;
+    {
+        std::lock_guard<std::mutex> lock(times_mutex_);
+        if (budget_ms_ > 0)
+        {
+            scale = scale_;
+            const FrameTimes &t = last_times_;
+            if (t.valid && t.raster > 0)
+            {
+                // 光栅化耗时与像素数成正比: t.raster * (target / t.scale)^2 = 预算减去固定开销
+                double room = std::max(0.0, budget_ms_ - t.geometry - t.output);
+                float target = t.scale * float(std::sqrt(room / t.raster));
+                // 超出预算时立即降低, 提高时每帧最多 10%; 变化不到 2% 时保持不变, 避免来回抖动
+                target = std::min(target, scale * 1.1f);
+                if (std::abs(target - scale) > 0.02f * scale)
+                    scale = target;
+            }
+            scale = std::min(1.f, std::max(min_scale_, scale));
+        }
+        scale_ = scale;
+    }
+
+    int w = std::max(1, int(width_ * scale + 0.5f));
+    int h = std::max(1, int(height_ * scale + 0.5f));
+    slot.scale = scale;
+    if (w == slot.width && h == slot.height)
+        return;
+    slot.width  = w;
+    slot.height = h;
+    slot.fb     = mygl::Framebuffer(w, h, mygl::Framebuffer::TILED, slot.fb.samples());
+    if (w != width_ || h != height_)
+    {
+        slot.scaled       = Image<RGB8>(w, h);
+        slot.scaled_depth = Image<Gray8>(w, h);
+        slot.scaled_memory.set(slot.scaled.bytes() + slot.scaled_depth.bytes());
+    }
+}
+
+void FramePipeline::geometry(Slot &slot)
+{
+    auto start = Clock::now();
+    resize(slot);
+    slot.view = cameraView(slot.camera, slot.width, slot.height);
+    GouraudShader &shader = slot.shader;
+    shader.setup(slot.view, DEFAULT_LIGHT);
+    shader.shading_rate = shading_rate_;
+
+    // 回收上一帧的临时数据, 分箱按上一帧的用量预留, 一般不用再扩容
+    slot.arena.reset();
+    mygl::ArenaAllocator<int> alloc(&slot.arena);
+    slot.triangles = mygl::ArenaVector<ShadedTriangle>(alloc);
+    for (auto &b : slot.bins)
+    {
+        size_t n = b.size();
+        b = mygl::ArenaVector<int>(alloc);
+        b.reserve(n);
+    }
+    for (auto &r : slot.rects)
+        r = mygl::ArenaVector<mygl::Rect>(alloc);
+    Scene &scene = slot.scene;
+
+    if (stream_model_ >= 0)
+    {
+        // 流式绘制不保存三角形, 读到一批就画一批
+        slot.fb.clear();
+        slot.drawn = false;
+        MeshStream stream(stream_file_.c_str(), stream_cap_);
+        MeshChunk chunk;
+        shader.model   = &scene.model(stream_model_);
+        shader.indices = nullptr;
+        while (stream.next(chunk))
+        {
+            shader.vertices = chunk.vertices.data();
+            drawFaces(shader, chunk.nfaces(), slot.fb);
+        }
+        if (!stream.ok())
+            std::cerr << "failed to stream " << stream_file_ << std::endl;
+        // 峰值另外计入 memstats 的 io 类, 退出时汇总输出
+        if (verbose_)
+            std::cerr << "frame " << slot.index << ": stream " << (stream.cached() ? "cache" : "obj") << ", "
+                      << stream.chunk_faces() << " faces per chunk, peak " << stream.peak_bytes() << " / cap "
+                      << stream_cap_ << " bytes" << std::endl;
+        slot.geometry_ms = elapsedMs(start);
+        return;
+    }
+
+    // 视锥剔除, 只有可见的实例才做顶点计算
+    Matrix4f vp = slot.view.transform();
+    scene.cull(vp, slot.width, slot.height, slot.visible);
+    mygl::ArenaVector<mygl::Rect> tiles(scene.ninstances(), NO_TILES, alloc);
+    for (int id : slot.visible)
+        tiles[id] = screenTiles(vp, scene.instance(id), slot.width, slot.height);
+    bool full = invalidate(slot, tiles);
+    // 三角形数不超过可见实例所选 LOD 的面数之和, 一次预留, Arena 上不留下扩容丢弃的缓冲
+    size_t nfaces = 0;
+    for (int id : slot.visible)
+    {
+        const Scene::Instance &inst = scene.instance(id);
+        nfaces += selectMesh(slot.view, scene.model(inst.model), inst.center, inst.scale).nfaces();
+    }
+    slot.triangles.reserve(nfaces);
+
+    ShadedTriangle tri;
+    int drawn = 0;
+    for (int id : slot.visible)
+    {
+        // 增量重画时跳过没有覆盖到要重画的分块的实例
+        const mygl::Rect &t = tiles[id];
+        bool touched = full;
+        for (int ty = t.y0; ty <= t.y1 && !touched; ty ++)
+            for (int tx = t.x0; tx <= t.x1 && !touched; tx ++)
+                touched = slot.dirty[size_t(ty) * slot.fb.tiles_x() + tx] != 0;
+        if (!touched)
+            continue;
+        drawn ++;
+
+        const Scene::Instance &inst = scene.instance(id);
+        Model &model = scene.model(inst.model);
+        const Mesh &mesh = selectMesh(slot.view, model, inst.center, inst.scale);
+        shader.model       = &model;
+        shader.uniform_MVP = vp * inst.transform;
+        shader.vertices    = model.vertices().data();
+        shader.indices     = mesh.indices.data();
+        for (int i = 0; i < mesh.nfaces(); i ++)
+        {
+            for (int j = 0; j < 3; j ++)
+                tri.pts[j] = shader.vertex(i, j);
+            std::memcpy(tri.varying, shader.varying, sizeof(tri.varying));
+            tri.nvaryings = shader.nvaryings;
+            tri.model     = &model;
+            bin(slot, tri);
+        }
+    }
+
+    // 记下帧缓冲现在的内容是怎样画出来的
+    slot.drawn        = incremental_;
+    slot.drawn_camera = slot.camera;
+    slot.drawn_width  = slot.width;
+    slot.drawn_height = slot.height;
+    slot.drawn_tiles.assign(tiles.begin(), tiles.end());
+    slot.drawn_transforms.resize(scene.ninstances());
+    for (int i = 0; i < scene.ninstances(); i ++)
+        slot.drawn_transforms[i] = scene.instance(i).transform;
+
+    if (verbose_)
+        std::cerr << "frame " << slot.index << ": " << slot.visible.size() << " / " << scene.ninstances()
+                  << " instances visible, " << slot.triangles.size() << " faces" << std::endl;
+    if (verbose_ && incremental_)
+        std::cerr << "frame " << slot.index << ": " << slot.ndirty << " / " << slot.dirty.size() << " tiles, "
+                  << drawn << " instances redrawn" << std::endl;
+    slot.geometry_ms = elapsedMs(start);
+}
+
+bool FramePipeline::invalidate(Slot &slot, const mygl::ArenaVector<mygl::Rect> &tiles)
+{
+    const int T = mygl::Framebuffer::TILE;
+    const int tiles_x = slot.fb.tiles_x(), tiles_y = slot.fb.tiles_y();
+    bool full = !incremental_ || !slot.drawn || adaptive_threshold_ > 0.f || slot.drawn_width != slot.width ||
+                slot.drawn_height != slot.height || !sameCamera(slot.drawn_camera, slot.camera) ||
+                slot.drawn_tiles.size() != tiles.size();
+
+    slot.dirty.assign(size_t(tiles_x) * tiles_y, full ? 1 : 0);
+    if (full)
+    {
+        slot.fb.clear();
+        slot.ndirty = int(slot.dirty.size());
+        for (int b = 0; b < nbands_ && b * band_ < slot.height; b ++)
+            slot.rects[b].push_back(mygl::Rect{0, b * band_, slot.width - 1, std::min(slot.height, (b + 1) * band_) - 1});
+        return true;
+    }
+
+    // 变换改变了的实例, 旧的和新的覆盖范围都要重画
+    auto mark = [&slot, tiles_x](const mygl::Rect &t)
+    {
+        for (int ty = t.y0; ty <= t.y1; ty ++)
+            for (int tx = t.x0; tx <= t.x1; tx ++)
+                slot.dirty[size_t(ty) * tiles_x + tx] = 1;
+    };
+    for (size_t i = 0; i < tiles.size(); i ++)
+    {
+        if (sameTransform(slot.drawn_transforms[i], slot.scene.instance(int(i)).transform))
+            continue;
+        mark(slot.drawn_tiles[i]);
+        mark(tiles[i]);
+    }
+
+    // 每个分块行中连续的脏分块合成一个矩形, 分块行不会跨条
+    slot.ndirty = 0;
+    for (int ty = 0; ty < tiles_y; ty ++)
+    {
+        for (int tx = 0; tx < tiles_x; tx ++)
+        {
+            if (!slot.dirty[size_t(ty) * tiles_x + tx])
+                continue;
+            int end = tx;
+            for (; end < tiles_x && slot.dirty[size_t(ty) * tiles_x + end]; end ++)
+                slot.fb.clear_tile(end, ty);
+            slot.ndirty += end - tx;
+            slot.rects[ty * T / band_].push_back(mygl::Rect{tx * T, ty * T, std::min(slot.width, end * T) - 1,
+                                                            std::min(slot.height, (ty + 1) * T) - 1});
+            tx = end;
+        }
+    }
+    return false;
+}
+
+// 按屏幕 y 范围放进覆盖到的各条, 与 triangle() 一样丢弃有顶点在相机平面之后或者坐标不是有限值的三角形
+void FramePipeline::bin(Slot &slot, ShadedTriangle &tri)
+{
+    if (!(tri.pts[0][3] > 0) || !(tri.pts[1][3] > 0) || !(tri.pts[2][3] > 0))
+        return;
+    float lo[2], hi[2];
+    for (int k = 0; k < 2; k ++)
+    {
+        lo[k] = hi[k] = tri.pts[0][k] / tri.pts[0][3];
+        if (!std::isfinite(lo[k]))
+            return;
+        for (int j = 1; j < 3; j ++)
+        {
+            float v = tri.pts[j][k] / tri.pts[j][3];
+            if (!std::isfinite(v))
+                return;
+            lo[k] = std::min(lo[k], v);
+            hi[k] = std::max(hi[k], v);
+        }
+        // 与 mygl::triangle 相同, 多重采样时包围盒向外扩半个像素
+        if (slot.fb.samples() > 1)
+        {
+            lo[k] -= 0.5f;
+            hi[k] += 0.5f;
+        }
+    }
+    if (!(lo[0] <= hi[0]) || !(lo[1] <= hi[1]) || hi[0] < 0.f || hi[1] < 0.f || lo[0] > float(slot.width - 1) ||
+        lo[1] > float(slot.height - 1))
+        return;
+    tri.bounds = mygl::Rect{int(std::max(lo[0], 0.f)), int(std::max(lo[1], 0.f)),
+                            int(std::floor(std::min(hi[0], float(slot.width - 1)))),
+                            int(std::floor(std::min(hi[1], float(slot.height - 1))))};
+
+    int index = int(slot.triangles.size());
+    slot.triangles.push_back(tri);
+    for (int b = tri.bounds.y0 / band_; b <= tri.bounds.y1 / band_; b ++)
+        slot.bins[b].push_back(index);
+}
+
+void FramePipeline::raster(Slot &slot, int band)
+{
+    // 每条一份着色器, 各条并行时互不干扰
+    auto start = Clock::now();
+    GouraudShader shader = slot.shader;
+    // 各矩形互不重叠, 每个像素上三角形仍然按提交顺序光栅化
+    for (const mygl::Rect &rect : slot.rects[band])
+    {
+        for (int i : slot.bins[band])
+        {
+            const ShadedTriangle &tri = slot.triangles[i];
+            const mygl::Rect &b = tri.bounds;
+            if (b.x1 < rect.x0 || b.x0 > rect.x1 || b.y1 < rect.y0 || b.y0 > rect.y1)
+                continue;
+            Vec4f pts[3] = {tri.pts[0], tri.pts[1], tri.pts[2]};
+            shader.model     = tri.model;
+            shader.nvaryings = tri.nvaryings;
+            std::memcpy(shader.varying, tri.varying, sizeof(tri.varying));
+            triangle(pts, shader, slot.fb, &rect);
+        }
+    }
+    slot.band_ms[band] = elapsedMs(start);
+}
+
+void FramePipeline::output(Slot &slot)
+{
+    auto start = Clock::now();
+    bool ok = true;
+    // 内部分辨率低于输出时先 resolve 到内部分辨率的图像, 再双线性放大
+    bool scaled = slot.width != width_ || slot.height != height_;
+    Image<RGB8> &color = scaled ? slot.scaled : slot.image.as<RGB8>();
+    slot.fb.resolve(color, scaled ? slot.scaled_depth : slot.zbuffer.as<Gray8>());
+    if (adaptive_threshold_ > 0.f)
+        slot.fb.adapt_shading_rates(color, adaptive_threshold_);
+    if (scaled)
+    {
+        imageops::resample(slot.scaled, slot.image.as<RGB8>());
+        imageops::resample(slot.scaled_depth, slot.zbuffer.as<Gray8>());
+    }
+    slot.image.flip_vertically();
+    slot.zbuffer.flip_vertically();
+    if (!slot.image_path.empty())
+        ok = slot.image.write_tga_file(slot.image_path.c_str()) && ok;
+    if (!slot.zbuffer_path.empty())
+        ok = slot.zbuffer.write_tga_file(slot.zbuffer_path.c_str()) && ok;
+    if (!ok)
+    {
+        std::cerr << "failed to write frame " << slot.image_path << "\n";
+        failures_ ++;
+    }
+
+    // 光栅化按实际有内容的条数和线程数折算成墙钟时间
+    FrameTimes times;
+    int bands = std::min(nbands_, (slot.height + band_ - 1) / band_);
+    int parallel = std::max(1, std::min(bands, int(scheduler_.nthreads())));
+    times.geometry = slot.geometry_ms;
+    times.raster   = std::accumulate(slot.band_ms.begin(), slot.band_ms.end(), 0.0) / parallel;
+    times.output   = elapsedMs(start);
+    times.scale    = slot.scale;
+    times.valid    = true;
+    std::lock_guard<std::mutex> lock(times_mutex_);
+    last_times_ = times;
+    if (budget_ms_ > 0)
+    {
+        char line[160];
+        std::snprintf(line, sizeof(line), "frame %d: %dx%d (scale %.2f), geometry %.1f ms, raster %.1f ms, output %.1f ms",
+                      slot.index, slot.width, slot.height, slot.scale, times.geometry, times.raster, times.output);
+        std::cerr << line << std::endl;
+    }
+}
@@ -0,0 +1,96 @@
+#include <cmath>
+#include <cstdio>
+#include "render.h"
+
+Camera turntable(const Camera &start, int i, int n)
+{
+    float angle = 2.f * M_PI * i / n;
+    Camera camera = start;
+    const Vec3f &e = start.eye;
+    camera.eye = Vec3f(e.x * std::cos(angle) + e.z * std::sin(angle),
+                       e.y,
+                       e.z * std::cos(angle) - e.x * std::sin(angle));
+    return camera;
+}
+
+std::string frameName(const char *prefix, int frame, int frames)
+{
+    if (frames == 1)
+        return std::string(prefix) + ".tga";
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "%s_%03d.tga", prefix, frame);
+    return buf;
+}
+
+bool validCamera(const Camera &camera)
+{
+    for (int k = 0; k < 3; k ++)
+        if (!std::isfinite(camera.eye[k]) || !std::isfinite(camera.center[k]) || !std::isfinite(camera.up[k]))
+            return false;
+    Vec3f eye = camera.eye;
+    if (eye.norm() == 0.f || (eye - camera.center).norm() == 0.f)
+        return false;
+    Vec3f dir = eye.normalize() - camera.center;
+    return dir.norm() > 0.f && (camera.up ^ dir).norm() > 0.f;
+}
+
+mygl::View cameraView(const Camera &camera, int width, int height)
+{
+    mygl::View view;
+    mygl::viewMatrix(view, camera.eye, camera.center, camera.up);
+    mygl::viewportMatrix(view, width / 8, height / 8, width * 3 / 4, height * 3 / 4);
+    mygl::projectionMatrix(view, -1.f / (camera.eye - camera.center).norm());
+    return view;
+}
+
+size_t frameBytes(int width, int height)
+{
+    return mygl::Framebuffer::bytes(width, height) + size_t(width) * height * (RGB8::bytespp + Gray8::bytespp);
+}
+
+Matrix4f normalMatrix()
+{
+    // (Projection*ModelView).invert_transpose() 的近似, 固定不变
+    Matrix4f mit = Matrix4f::identity();
+    mit[3][2] = 0.333333;
+    return mit;
+}
+
+void GouraudShader::setup(const mygl::View &view, Vec3f light)
+{
+    uniform_light = light.normalize();
+    uniform_M     = view.projection * view.modelView;
+    uniform_l     = proj<3>(uniform_M * embed<4>(uniform_light)).normalize();
+    uniform_MIT   = normalMatrix();
+    uniform_MVP   = view.transform();
+}
+
+void drawFaces(GouraudShader &shader, int nfaces, mygl::Framebuffer &fb)
+{
+    for (int i = 0; i < nfaces; i ++)
+    {
+        Vec4f screen_coords[3];
+        for (int j = 0; j < 3; j ++)
+            screen_coords[j] = shader.vertex(i, j);
+        triangle(screen_coords, shader, fb);
+    }
+}
+
+const Mesh &selectMesh(const mygl::View &view, const Model &model, Vec3f center, float scale)
+{
+    Vec4f c = view.projection * view.modelView * embed<4>(center, 1.f);
+    return model.lod(model.select_lod(view.viewport[0][0] * scale / c[3]));
+}
+
+long drawInstance(GouraudShader &shader, const mygl::View &view, Model &model, const Matrix4f &transform,
+                  Vec3f center, float scale, mygl::Framebuffer &fb)
+{
+    shader.model       = &model;
+    shader.uniform_MVP = view.transform() * transform;
+
+    const Mesh &mesh = selectMesh(view, model, center, scale);
+    shader.vertices = model.vertices().data();
+    shader.indices  = mesh.indices.data();
+    drawFaces(shader, mesh.nfaces(), fb);
+    return mesh.nfaces();
+}
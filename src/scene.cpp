@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cmath>
+#include "scene.h"
+
+Frustum::Frustum(const Matrix4f &m, int width, int height)
+{
+    // 屏幕坐标 x = row0 * p / row3 * p, w = row3 * p > 0 时 0 <= x <= width 等价于
+    // row0 * p >= 0 且 (width * row3 - row0) * p >= 0, y 同理
+    Vec4f r0 = m[0], r1 = m[1], r3 = m[3];
+    planes_[0] = r0;
+    planes_[1] = r3 * float(width) - r0;
+    planes_[2] = r1;
+    planes_[3] = r3 * float(height) - r1;
+    planes_[4] = r3;
+}
+
+Frustum::Result Frustum::classify(const Vec3f &lo, const Vec3f &hi) const
+{
+    Result result = INSIDE;
+    for (const Vec4f &p : planes_)
+    {
+        // 包围盒在平面法线方向上最远和最近的角
+        Vec3f far, near;
+        for (int i = 0; i < 3; i ++)
+        {
+            far[i]  = p[i] >= 0 ? hi[i] : lo[i];
+            near[i] = p[i] >= 0 ? lo[i] : hi[i];
+        }
+        if (p[0] * far[0] + p[1] * far[1] + p[2] * far[2] + p[3] < 0)
+            return OUTSIDE;
+        if (p[0] * near[0] + p[1] * near[1] + p[2] * near[2] + p[3] < 0)
+            result = INTERSECT;
+    }
+    return result;
+}
+
+int Scene::add_model(std::shared_ptr<Model> model)
+{
+    models_.push_back(std::move(model));
+    return int(models_.size()) - 1;
+}
+
+void Scene::place(Instance &inst, const Matrix4f &transform) const
+{
+    const Model &m = *models_[inst.model];
+    inst.transform = transform;
+    inst.center    = proj<3>(transform * embed<4>(m.center(), 1.f));
+    inst.scale     = 0.f;
+    for (int j = 0; j < 3; j ++)
+        inst.scale = std::max(inst.scale, proj<3>(transform.col(j)).norm());
+    inst.radius = m.radius() * inst.scale;
+}
+
+int Scene::add_instance(int model, const Matrix4f &transform)
+{
+    Instance inst;
+    inst.model = model;
+    place(inst, transform);
+    instances_.push_back(inst);
+    return int(instances_.size()) - 1;
+}
+
+void Scene::set_transform(int i, const Matrix4f &transform)
+{
+    place(instances_[i], transform);
+}
+
+void Scene::bounds(Node &node) const
+{
+    node.lo = node.hi = instances_[order_[node.first]].center;
+    for (int i = node.first; i < node.first + node.count; i ++)
+    {
+        const Instance &inst = instances_[order_[i]];
+        for (int k = 0; k < 3; k ++)
+        {
+            node.lo[k] = std::min(node.lo[k], inst.center[k] - inst.radius);
+            node.hi[k] = std::max(node.hi[k], inst.center[k] + inst.radius);
+        }
+    }
+}
+
+void Scene::refit()
+{
+    // 子节点总在父节点之后, 倒序遍历时子节点已经更新
+    for (int i = int(nodes_.size()) - 1; i >= 0; i --)
+    {
+        Node &node = nodes_[i];
+        if (node.left < 0)
+        {
+            bounds(node);
+            continue;
+        }
+        const Node &a = nodes_[node.left], &b = nodes_[node.left + 1];
+        for (int k = 0; k < 3; k ++)
+        {
+            node.lo[k] = std::min(a.lo[k], b.lo[k]);
+            node.hi[k] = std::max(a.hi[k], b.hi[k]);
+        }
+    }
+}
+
+void Scene::build()
+{
+    nodes_.clear();
+    order_.resize(instances_.size());
+    for (size_t i = 0; i < order_.size(); i ++)
+        order_[i] = int(i);
+    if (instances_.empty())
+        return;
+    nodes_.reserve(2 * instances_.size() / LEAF_SIZE + 1);
+    nodes_.push_back(Node());
+    build(0, 0, int(instances_.size()));
+}
+
+// 按包围盒最长轴的中位数二分, 两个子节点相邻存放
+void Scene::build(int index, int first, int count)
+{
+    Node node;
+    node.first = first;
+    node.count = count;
+    node.left  = -1;
+    bounds(node);
+
+    if (count > LEAF_SIZE)
+    {
+        int axis = 0;
+        for (int k = 1; k < 3; k ++)
+            if (node.hi[k] - node.lo[k] > node.hi[axis] - node.lo[axis])
+                axis = k;
+        int half = count / 2;
+        std::nth_element(order_.begin() + first, order_.begin() + first + half, order_.begin() + first + count,
+                         [this, axis](int a, int b) { return instances_[a].center[axis] < instances_[b].center[axis]; });
+
+        node.left = int(nodes_.size());
+        nodes_.push_back(Node());
+        nodes_.push_back(Node());
+        build(node.left, first, half);
+        build(node.left + 1, first + half, count - half);
+    }
+    nodes_[index] = node;
+}
+
+void Scene::cull(const Matrix4f &m, int width, int height, std::vector<int> &visible) const
+{
+    visible.clear();
+    if (nodes_.empty())
+        return;
+
+    Frustum frustum(m, width, height);
+    int stack[64];
+    int top = 0;
+    stack[top ++] = 0;
+    while (top > 0)
+    {
+        const Node &node = nodes_[stack[-- top]];
+        Frustum::Result r = frustum.classify(node.lo, node.hi);
+        if (r == Frustum::OUTSIDE)
+            continue;
+        // 整个节点在视锥内, 子树内的实例直接全部可见; 与视锥相交的叶子逐个检查
+        if (r == Frustum::INSIDE || node.left < 0)
+        {
+            for (int i = node.first; i < node.first + node.count; i ++)
+            {
+                const Instance &inst = instances_[order_[i]];
+                Vec3f extent(inst.radius, inst.radius, inst.radius);
+                if (r == Frustum::INSIDE || frustum.classify(inst.center - extent, inst.center + extent) != Frustum::OUTSIDE)
+                    visible.push_back(order_[i]);
+            }
+            continue;
+        }
+        stack[top ++] = node.left;
+        stack[top ++] = node.left + 1;
+    }
+}
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include "scheduler.h"
+
+mygl::Scheduler::Scheduler(size_t nthreads)
+{
+    if (nthreads == 0)
+        nthreads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < nthreads; i ++)
+        threads_.emplace_back(&Scheduler::worker, this);
+}
+
+mygl::Scheduler::~Scheduler()
+{
+    wait_all();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    ready_cv_.notify_all();
+    for (auto &t : threads_)
+        t.join();
+}
+
+bool mygl::Scheduler::live(Task task) const
+{
+    size_t index = size_t(task & 0xffffffffu);
+    return index < nodes_.size() && nodes_[index].generation == uint32_t(task >> 32);
+}
+
+void mygl::Scheduler::grow_ready(size_t capacity)
+{
+    // 按队列顺序搬到新的缓冲的开头
+    std::vector<uint32_t> grown(capacity);
+    for (size_t i = 0; i < ready_count_; i ++)
+        grown[i] = ready_[(ready_head_ + i) % ready_.size()];
+    ready_.swap(grown);
+    ready_head_ = 0;
+}
+
+void mygl::Scheduler::push_ready(uint32_t index)
+{
+    if (ready_count_ == ready_.size())
+        grow_ready(std::max<size_t>(16, ready_.size() * 2));
+    ready_[(ready_head_ + ready_count_ ++) % ready_.size()] = index;
+}
+
+void mygl::Scheduler::reserve(size_t tasks, size_t dependents)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.reserve(tasks);
+    while (nodes_.size() < tasks)
+    {
+        free_.push_back(uint32_t(nodes_.size()));
+        nodes_.emplace_back();
+    }
+    for (Node &node : nodes_)
+        node.dependents.reserve(dependents);
+    if (ready_.size() < tasks)
+        grow_ready(tasks);
+}
+
+mygl::Scheduler::Task mygl::Scheduler::add(std::function<void()> fn, const std::vector<Task> &deps)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint32_t index;
+    if (!free_.empty())
+    {
+        index = free_.back();
+        free_.pop_back();
+    }
+    else
+    {
+        index = uint32_t(nodes_.size());
+        nodes_.emplace_back();
+    }
+    Node &node = nodes_[index];
+    node.fn = std::move(fn);
+    node.pending = 0;
+    Task id = Task(node.generation) << 32 | index;
+    for (Task dep : deps)
+    {
+        if (!live(dep) || dep == id)
+            continue;
+        nodes_[size_t(dep & 0xffffffffu)].dependents.push_back(index);
+        node.pending ++;
+    }
+    live_ ++;
+    if (node.pending == 0)
+    {
+        push_ready(index);
+        lock.unlock();
+        ready_cv_.notify_one();
+    }
+    return id;
+}
+
+void mygl::Scheduler::wait(Task task)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this, task] { return !live(task); });
+}
+
+void mygl::Scheduler::wait_all()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return live_ == 0; });
+}
+
+void mygl::Scheduler::worker()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        ready_cv_.wait(lock, [this] { return stop_ || ready_count_ > 0; });
+        if (ready_count_ == 0)
+            return;
+        uint32_t index = ready_[ready_head_];
+        ready_head_ = (ready_head_ + 1) % ready_.size();
+        ready_count_ --;
+        std::function<void()> fn = std::move(nodes_[index].fn);
+        nodes_[index].fn = nullptr;
+
+        lock.unlock();
+        fn();
+        fn = nullptr;
+        lock.lock();
+
+        // 依赖本任务的任务少一个未完成的依赖, 减到零就绪
+        Node &node = nodes_[index];
+        size_t woken = 0;
+        for (uint32_t t : node.dependents)
+        {
+            if (-- nodes_[t].pending == 0)
+            {
+                push_ready(t);
+                woken ++;
+            }
+        }
+        node.dependents.clear();
+        node.generation ++;
+        free_.push_back(index);
+        live_ --;
+        if (woken > 1)
+            ready_cv_.notify_all();
+        else if (woken == 1)
+            ready_cv_.notify_one();
+        done_cv_.notify_all();
+    }
+}
@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <thread>
+#include <vector>
+#include "memstats.h"
+#include "server.h"
+
+namespace
+{
+bool readVec3(const json::Value *v, const char *name, Vec3f &out, std::string &error)
+{
+    if (!v)
+        return true;
+    if (v->type != json::Value::ARRAY || v->array.size() != 3)
+    {
+        error = std::string(name) + " must be an array of 3 numbers";
+        return false;
+    }
+    for (int i = 0; i < 3; i ++)
+    {
+        if (v->array[i].type != json::Value::NUMBER || !std::isfinite(v->array[i].number))
+        {
+            error = std::string(name) + " must be an array of 3 numbers";
+            return false;
+        }
+        out[i] = float(v->array[i].number);
+    }
+    return true;
+}
+
+bool readString(const json::Value *v, const char *name, std::string &out, std::string &error)
+{
+    if (!v)
+        return true;
+    if (v->type != json::Value::STRING || v->string.empty())
+    {
+        error = std::string(name) + " must be a non-empty string";
+        return false;
+    }
+    out = v->string;
+    return true;
+}
+
+bool readSize(const json::Value *v, const char *name, int &out, std::string &error)
+{
+    if (!v)
+        return true;
+    if (v->type != json::Value::NUMBER || v->number < 1 || v->number > server::MAX_SIZE ||
+        v->number != std::floor(v->number))
+    {
+        error = std::string(name) + " must be an integer in [1, " + std::to_string(server::MAX_SIZE) + "]";
+        return false;
+    }
+    out = int(v->number);
+    return true;
+}
+}
+
+bool server::parseJob(const json::Value &request, Job &job, std::string &error)
+{
+    if (request.type != json::Value::OBJECT)
+    {
+        error = "request must be an object";
+        return false;
+    }
+    if (const json::Value *id = request.get("id"))
+        job.id = *id;
+
+    const json::Value *camera = request.get("camera");
+    if (camera && camera->type != json::Value::OBJECT)
+    {
+        error = "camera must be an object";
+        return false;
+    }
+    if (camera && (!readVec3(camera->get("eye"), "camera.eye", job.camera.eye, error) ||
+                   !readVec3(camera->get("center"), "camera.center", job.camera.center, error) ||
+                   !readVec3(camera->get("up"), "camera.up", job.camera.up, error)))
+        return false;
+    if (!readVec3(request.get("light"), "light", job.light, error) ||
+        !readString(request.get("model"), "model", job.model, error) ||
+        !readString(request.get("output"), "output", job.output, error) ||
+        !readString(request.get("zbuffer"), "zbuffer", job.zbuffer, error) ||
+        !readSize(request.get("width"), "width", job.width, error) ||
+        !readSize(request.get("height"), "height", job.height, error))
+        return false;
+    if (const json::Value *compress = request.get("compress"))
+    {
+        if (compress->type != json::Value::BOOL)
+        {
+            error = "compress must be a boolean";
+            return false;
+        }
+        job.compress = compress->boolean;
+    }
+    if (const json::Value *memory = request.get("memory_mb"))
+    {
+        if (memory->type != json::Value::NUMBER || !(memory->number > 0) || memory->number > 1024 * 1024)
+        {
+            error = "memory_mb must be a positive number";
+            return false;
+        }
+        job.memory_limit = size_t(memory->number * 1024 * 1024);
+    }
+
+    if (job.output.empty())
+    {
+        error = "output is required";
+        return false;
+    }
+    // 视线方向为零或者与 up 平行时视图矩阵没有定义
+    if (!validCamera(job.camera))
+    {
+        error = "camera eye, center and up are degenerate";
+        return false;
+    }
+    if (job.light.norm() == 0.f)
+    {
+        error = "light must be non-zero";
+        return false;
+    }
+    return true;
+}
+
+server::RenderServer::RenderServer(size_t nworkers, size_t queue_depth, size_t memory_limit)
+    : nworkers_(nworkers ? nworkers : std::max(1u, std::thread::hardware_concurrency())),
+      queue_depth_(queue_depth ? queue_depth : 2 * nworkers_), memory_limit_(memory_limit)
+{
+}
+
+std::shared_ptr<Model> server::RenderServer::model(const std::string &path, bool compress)
+{
+    std::error_code ec;
+    std::string key = std::filesystem::weakly_canonical(path, ec).string();
+    if (ec)
+        key = path;
+    key += compress ? "#compressed" : "";
+
+    std::promise<std::shared_ptr<Model>> promise;
+    ModelHandle handle;
+    {
+        std::lock_guard<std::mutex> lock(models_mutex_);
+        auto it = models_.find(key);
+        if (it != models_.end())
+            return it->second.get();
+        handle = promise.get_future().share();
+        models_.emplace(key, handle);
+    }
+
+    // 第一个请求的任务负责加载, 同一模型的其他任务等待同一个结果
+    auto model = std::make_shared<Model>(path.c_str(), Texture::LINEAR, compress);
+    if (model->nfaces() == 0)
+    {
+        model = nullptr;
+        // 失败的不缓存 (AssetManager 也不缓存加载失败的网格), 文件补上后可以重试
+        std::lock_guard<std::mutex> lock(models_mutex_);
+        models_.erase(key);
+    }
+    else
+        model->prepare_view_normals(normalMatrix());
+    promise.set_value(model);
+    return model;
+}
+
+bool server::RenderServer::render(const Job &job, long &faces, size_t &memory, std::string &error)
+{
+    std::shared_ptr<Model> m = model(job.model, job.compress);
+    if (!m)
+    {
+        error = "failed to load model " + job.model;
+        return false;
+    }
+
+    // 分配之前按尺寸估算, 放不下的任务不碰内存
+    size_t limit = job.memory_limit ? job.memory_limit : memory_limit_;
+    size_t needed = frameBytes(job.width, job.height);
+    if (limit > 0 && needed > limit)
+    {
+        error = "job needs " + std::to_string(needed) + " bytes, over the memory limit of " + std::to_string(limit);
+        return false;
+    }
+
+    // 共享的模型加载完之后才开始统计, 只计这个任务自己的帧缓冲和图像, 峰值用于回复
+    memstats::Job usage(limit);
+    memstats::JobScope scope(usage);
+    mygl::Framebuffer fb(job.width, job.height);
+    TGAImage image(job.width, job.height, TGAImage::RGB);
+    TGAImage zbuffer(job.width, job.height, TGAImage::GRAYSCALE);
+
+    // 相机状态在每个任务自己的视图里, 任务之间互不影响
+    mygl::View view = cameraView(job.camera, job.width, job.height);
+    GouraudShader shader;
+    shader.setup(view, job.light);
+    faces = drawInstance(shader, view, *m, Matrix4f::identity(), m->center(), 1.f, fb);
+
+    fb.resolve(image.as<RGB8>(), zbuffer.as<Gray8>());
+    image.flip_vertically();
+    if (!image.write_tga_file(job.output.c_str()))
+    {
+        error = "failed to write " + job.output;
+        return false;
+    }
+    zbuffer.flip_vertically();
+    if (!job.zbuffer.empty() && !zbuffer.write_tga_file(job.zbuffer.c_str()))
+    {
+        error = "failed to write " + job.zbuffer;
+        return false;
+    }
+    memory = usage.peak();
+    return true;
+}
+
+void server::RenderServer::reply(const json::Value &id, bool ok, const std::string &body)
+{
+    std::string line = "{\"id\":" + json::dump(id) + ",\"ok\":" + (ok ? "true," : "false,") + body + "}\n";
+    std::lock_guard<std::mutex> lock(out_mutex_);
+    *out_ << line << std::flush;
+}
+
+void server::RenderServer::worker()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queue_cv_.wait(lock, [this] { return done_ || !queue_.empty(); });
+            if (queue_.empty())
+                return;
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        // 队列腾出了位置, 唤醒读取输入的线程
+        space_cv_.notify_one();
+
+        auto start = std::chrono::steady_clock::now();
+        long faces = 0;
+        size_t memory = 0;
+        std::string error;
+        bool ok = render(job, faces, memory, error);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (ok)
+        {
+            char timing[32];
+            std::snprintf(timing, sizeof(timing), "%.1f", ms);
+            reply(job.id, true, "\"output\":" + json::quote(job.output) + ",\"faces\":" + std::to_string(faces) +
+                                    ",\"ms\":" + timing + ",\"memory\":" + std::to_string(memory));
+        }
+        else
+        {
+            reply(job.id, false, "\"error\":" + json::quote(error));
+            std::lock_guard<std::mutex> lock(mutex_);
+            failures_ ++;
+        }
+    }
+}
+
+size_t server::RenderServer::serve(std::istream &in, std::ostream &out)
+{
+    out_ = &out;
+    done_ = false;
+    failures_ = 0;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < nworkers_; i ++)
+        threads.emplace_back(&RenderServer::worker, this);
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+
+        // 格式错误的请求直接在读取线程上回复, 不占队列
+        json::Value request;
+        Job job;
+        std::string error;
+        bool ok = json::parse(line, request, &error);
+        if (!ok)
+            error = "invalid JSON: " + error;
+        else if (const json::Value *id = request.get("id"))
+            job.id = *id;
+        if (!ok || !parseJob(request, job, error))
+        {
+            reply(job.id, false, "\"error\":" + json::quote(error));
+            std::lock_guard<std::mutex> lock(mutex_);
+            failures_ ++;
+            continue;
+        }
+
+        // 队列满时阻塞, 不再读取输入
+        std::unique_lock<std::mutex> lock(mutex_);
+        space_cv_.wait(lock, [this] { return queue_.size() < queue_depth_; });
+        queue_.push_back(std::move(job));
+        lock.unlock();
+        queue_cv_.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+    }
+    queue_cv_.notify_all();
+    for (auto &t : threads)
+        t.join();
+    return failures_;
+}
+
+int server::run(int argc, char **argv)
+{
+    size_t nworkers = argc > 0 ? size_t(std::max(0, std::atoi(argv[0]))) : 0;
+    size_t queue = argc > 1 ? size_t(std::max(0, std::atoi(argv[1]))) : 0;
+    size_t memory = argc > 2 ? size_t(std::max(0.0, std::atof(argv[2])) * 1024 * 1024) : 0;
+    RenderServer server(nworkers, queue, memory);
+    std::cerr << "# server: " << server.nworkers() << " workers, queue " << server.queue_depth();
+    if (server.memory_limit())
+        std::cerr << ", " << server.memory_limit() / (1024 * 1024) << " MB per job";
+    std::cerr << std::endl;
+    // 标准输出只留给结果, 贴图加载等写到 std::cout 的日志改到标准错误
+    std::ostream replies(std::cout.rdbuf());
+    std::streambuf *saved = std::cout.rdbuf(std::cerr.rdbuf());
+    size_t failures = server.serve(std::cin, replies);
+    std::cout.rdbuf(saved);
+    return failures == 0 ? 0 : 1;
+}
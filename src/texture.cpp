@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "texture.h"
+
+Texture::Texture()
+    : memory_(memstats::TEXTURE), width_(0), height_(0), bytespp_(0), tiles_x_(0), layout_(LINEAR), compression_(UNCOMPRESSED), block_bytes_(0)
+{
+}
+
+Texture::Texture(TGAImage &img, Layout layout, Compression compression, memstats::Category category)
+    : memory_(category), width_(img.get_width()), height_(img.get_height()), bytespp_(img.get_bytespp()), tiles_x_(0),
+      layout_(layout), compression_(compression), block_bytes_(0)
+{
+    if (!img.buffer() || width_ <= 0 || height_ <= 0)
+    {
+        width_ = height_ = bytespp_ = 0;
+        compression_ = UNCOMPRESSED;
+        return;
+    }
+    if (compression_ != UNCOMPRESSED)
+    {
+        compress(img);
+        memory_.set(data_.size());
+        return;
+    }
+
+    // 分块和Z序需要把尺寸补齐到块大小 / 2的幂
+    size_t ntexels = size_t(width_) * height_;
+    if (layout_ == TILED)
+    {
+        tiles_x_ = (width_ + TILE - 1) / TILE;
+        int tiles_y = (height_ + TILE - 1) / TILE;
+        ntexels = size_t(tiles_x_) * tiles_y * TILE * TILE;
+    }
+    else if (layout_ == MORTON)
+    {
+        int side = 1;
+        while (side < width_ || side < height_)
+            side <<= 1;
+        ntexels = size_t(side) * side;
+    }
+
+    data_.assign(ntexels * bytespp_, 0);
+    const unsigned char *src = img.buffer();
+    for (int y = 0; y < height_; y ++)
+        for (int x = 0; x < width_; x ++)
+            memcpy(data_.data() + index(x, y) * bytespp_, src + (size_t(y) * width_ + x) * bytespp_, bytespp_);
+    memory_.set(data_.size());
+}
+
+TGAImage Texture::to_image() const
+{
+    TGAImage img(width_, height_, bytespp_);
+    for (int y = 0; y < height_; y ++)
+        for (int x = 0; x < width_; x ++)
+            img.set(x, y, fetch(x, y));
+    return img;
+}
+
+void Texture::compress(TGAImage &img)
+{
+    layout_  = TILED;
+    tiles_x_ = (width_ + TILE - 1) / TILE;
+    int tiles_y = (height_ + TILE - 1) / TILE;
+
+    if (compression_ == BC5)
+    {
+        // BC5 只能表示 z >= 0 的法线
+        for (int y = 0; y < height_ && compression_ == BC5; y ++)
+            for (int x = 0; x < width_; x ++)
+                if (img.get(x, y)[0] < 127)
+                {
+                    compression_ = BC1;
+                    break;
+                }
+    }
+    block_bytes_ = compression_ == BC5 ? 16 : 8;
+    data_.assign(size_t(tiles_x_) * tiles_y * block_bytes_, 0);
+
+    TGAColor texels[16];
+    unsigned char a[16], b[16];
+    for (int by = 0; by < tiles_y; by ++)
+    {
+        for (int bx = 0; bx < tiles_x_; bx ++)
+        {
+            // 块超出图像的部分用边缘纹素补齐
+            for (int i = 0; i < 16; i ++)
+            {
+                int x = std::min(bx * TILE + (i & 3), width_ - 1);
+                int y = std::min(by * TILE + (i >> 2), height_ - 1);
+                texels[i] = img.get(x, y);
+                if (bytespp_ == 1)
+                    texels[i] = TGAColor(texels[i][0]);
+                a[i] = compression_ == BC4 ? texels[i][0] : texels[i].r;
+                b[i] = texels[i].g;
+            }
+
+            unsigned char *block = data_.data() + (size_t(by) * tiles_x_ + bx) * block_bytes_;
+            switch (compression_)
+            {
+            case BC1: blockcompress::encode_bc1(texels, block); break;
+            case BC4: blockcompress::encode_bc4(a, block); break;
+            default:  blockcompress::encode_bc5(a, b, block); break;
+            }
+        }
+    }
+}
+
+TGAColor Texture::fetch_compressed(int x, int y) const
+{
+    const unsigned char *block = data_.data() + (size_t(y / TILE) * tiles_x_ + x / TILE) * block_bytes_;
+    int i = (y % TILE) * TILE + (x % TILE);
+    switch (compression_)
+    {
+    case BC1:
+        return blockcompress::decode_bc1(block, i);
+    case BC4:
+        return TGAColor(blockcompress::decode_bc4(block, i));
+    default:
+    {
+        unsigned char r = blockcompress::decode_bc4(block, i);
+        unsigned char g = blockcompress::decode_bc4(block + 8, i);
+        float nx = r * 2.f / 255.f - 1.f, ny = g * 2.f / 255.f - 1.f;
+        float nz = std::sqrt(std::max(0.f, 1.f - nx * nx - ny * ny));
+        return TGAColor(r, g, (unsigned char)((nz + 1.f) * 127.5f + .5f));
+    }
+    }
+}
+
+// 切线方向范围 (-1, 1) 映射到了 (0, 255), 这里映射回来并归一化
+static Vec3f decodeNormal(TGAColor c)
+{
+    Vec3f n = Vec3f{(float)c[2], (float)c[1], (float)c[0]} * 2.f / 255.f - Vec3f{1, 1, 1};
+    return n.norm() > 0 ? n.normalize() : n;
+}
+
+NormalMap::NormalMap() : width_(0), height_(0), outside_(decodeNormal(TGAColor()))
+{
+}
+
+// 与着色器相同, 法线做 proj<3>(m * embed<4>(n)) 后重新归一化
+static Vec3f transformNormal(const Matrix4f &m, Vec3f n)
+{
+    n = proj<3>(m * embed<4>(n));
+    return n.norm() > 0 ? n.normalize() : n;
+}
+
+NormalMap::NormalMap(const Texture &tex, const Matrix4f &m)
+    : data_(size_t(tex.width()) * tex.height()), width_(tex.width()), height_(tex.height()),
+      outside_(transformNormal(m, decodeNormal(TGAColor())))
+{
+    for (int y = 0; y < height_; y ++)
+        for (int x = 0; x < width_; x ++)
+            data_[size_t(y) * width_ + x] = encode(transformNormal(m, decodeNormal(tex.fetch(x, y))));
+    memory_.set(bytes());
+}
+
+uint32_t NormalMap::encode(Vec3f n)
+{
+    float s = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (s == 0.f)
+        return encode(Vec3f(0, 0, 1));
+    float x = n.x / s, y = n.y / s;
+    if (n.z < 0.f)
+    {
+        float fx = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+        float fy = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+        x = fx;
+        y = fy;
+    }
+    auto quantize = [](float v) { return uint32_t(std::lround((std::min(std::max(v, -1.f), 1.f) * .5f + .5f) * 65535.f)); };
+    return quantize(x) | quantize(y) << 16;
+}
+
+MaterialMap::MaterialMap() : width_(0), height_(0), outside_()
+{
+}
+
+bool MaterialMap::compatible(const Texture &diffuse, const Texture &specular, const NormalMap &normals)
+{
+    return !diffuse.empty() && !specular.empty() && !normals.empty() &&
+           diffuse.width() == specular.width() && diffuse.width() == normals.width() &&
+           diffuse.height() == specular.height() && diffuse.height() == normals.height();
+}
+
+MaterialMap::MaterialMap(const Texture &diffuse, const Texture &specular, const NormalMap &normals)
+    : width_(0), height_(0), outside_()
+{
+    // 越界时与分别采样三张贴图的结果一致
+    outside_.normal  = normals.sample(Vec2f(-1.f, -1.f));
+    outside_.diffuse = TGAColor();
+    if (!compatible(diffuse, specular, normals))
+        return;
+
+    width_  = diffuse.width();
+    height_ = diffuse.height();
+    data_.resize(size_t(width_) * height_);
+    for (int y = 0; y < height_; y ++)
+    {
+        for (int x = 0; x < width_; x ++)
+        {
+            MaterialTexel &t = data_[size_t(y) * width_ + x];
+            t.normal    = normals.sample(Vec2f((x + .5f) / width_, (y + .5f) / height_));
+            t.diffuse   = diffuse.fetch(x, y);
+            t.diffuse.a = specular.fetch(x, y)[0];
+        }
+    }
+    memory_.set(bytes());
+}
@@ -1,9 +1,26 @@
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <string.h>
 #include <time.h>
 #include <math.h>
 #include "tgaimage.h"
+#include "imageops.h"
+
+namespace
+{
+// 取 variant 中图像的像素指针, 空图像返回 NULL
+struct BufferOf
+{
+	unsigned char *operator()(std::monostate &) const { return NULL; }
+
+	template <class Format>
+	unsigned char *operator()(Image<Format> &img) const
+	{
+		return img.empty() ? NULL : img.buffer();
+	}
+};
+}
 
 
 int TGAImage::getWidth()
@@ -20,50 +37,87 @@ TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0)
 {
 }
 
-TGAImage::TGAImage(int w, int h, int bpp) : data(NULL), width(w), height(h), bytespp(bpp)
+TGAImage::TGAImage(int w, int h, int bpp) : data(NULL), width(0), height(0), bytespp(0)
+{
+	allocate(w, h, bpp);
+}
+
+TGAImage::TGAImage(const TGAImage &img) : storage(img.storage), data(NULL), memory(img.memory), width(img.width), height(img.height), bytespp(img.bytespp)
 {
-	unsigned long nbytes = width * height * bytespp;
-	data = new unsigned char[nbytes];
-	memset(data, 0, nbytes);
+	data = std::visit(BufferOf(), storage);
 }
 
-TGAImage::TGAImage(const TGAImage &img)
+TGAImage::TGAImage(TGAImage &&img) : storage(std::move(img.storage)), data(NULL), memory(std::move(img.memory)), width(img.width), height(img.height), bytespp(img.bytespp)
 {
-	width = img.width;
-	height = img.height;
-	bytespp = img.bytespp;
-	unsigned long nbytes = width * height * bytespp;
-	data = new unsigned char[nbytes];
-	memcpy(data, img.data, nbytes);
+	data = std::visit(BufferOf(), storage);
+	img.storage = std::monostate();
+	img.data = NULL;
+	img.width = img.height = img.bytespp = 0;
 }
 
 TGAImage::~TGAImage()
 {
-	if (data)
-		delete[] data;
 }
 
 TGAImage &TGAImage::operator=(const TGAImage &img)
 {
 	if (this != &img)
 	{
-		if (data)
-			delete[] data;
+		storage = img.storage;
+		memory = img.memory;
+		width = img.width;
+		height = img.height;
+		bytespp = img.bytespp;
+		data = std::visit(BufferOf(), storage);
+	}
+	return *this;
+}
+
+TGAImage &TGAImage::operator=(TGAImage &&img)
+{
+	if (this != &img)
+	{
+		storage = std::move(img.storage);
+		memory = std::move(img.memory);
 		width = img.width;
 		height = img.height;
 		bytespp = img.bytespp;
-		unsigned long nbytes = width * height * bytespp;
-		data = new unsigned char[nbytes];
-		memcpy(data, img.data, nbytes);
+		data = std::visit(BufferOf(), storage);
+		img.storage = std::monostate();
+		img.data = NULL;
+		img.width = img.height = img.bytespp = 0;
 	}
 	return *this;
 }
 
+// 按 bpp 选择对应格式的存储, 像素清零
+void TGAImage::allocate(int w, int h, int bpp)
+{
+	switch (bpp)
+	{
+	case GRAYSCALE:
+		storage = Image<Gray8>(w, h);
+		break;
+	case RGB:
+		storage = Image<RGB8>(w, h);
+		break;
+	case RGBA:
+		storage = Image<RGBA8>(w, h);
+		break;
+	default:
+		storage = std::monostate();
+		break;
+	}
+	width = w;
+	height = h;
+	bytespp = bpp;
+	data = std::visit(BufferOf(), storage);
+	memory.set(data ? size_t(w) * h * bpp : 0);
+}
+
 bool TGAImage::read_tga_file(const char *filename)
 {
-	if (data)
-		delete[] data;
-	data = NULL;
+	allocate(0, 0, 0);
 	std::ifstream in;
 	in.open(filename, std::ios::binary);
 	if (!in.is_open())
@@ -80,17 +134,15 @@ bool TGAImage::read_tga_file(const char *filename)
 		std::cerr << "an error occured while reading the header\n";
 		return false;
 	}
-	width = header.width;
-	height = header.height;
-	bytespp = header.bitsperpixel >> 3;
-	if (width <= 0 || height <= 0 || (bytespp != GRAYSCALE && bytespp != RGB && bytespp != RGBA))
+	int bpp = header.bitsperpixel >> 3;
+	if (header.width <= 0 || header.height <= 0 || (bpp != GRAYSCALE && bpp != RGB && bpp != RGBA))
 	{
 		in.close();
 		std::cerr << "bad bpp (or width/height) value\n";
 		return false;
 	}
+	allocate(header.width, header.height, bpp);
 	unsigned long nbytes = bytespp * width * height;
-	data = new unsigned char[nbytes];
 	if (3 == header.datatypecode || 2 == header.datatypecode)
 	{
 		in.read((char *)data, nbytes);
@@ -319,7 +371,16 @@ TGAColor TGAImage::get(int x, int y)
 	{
 		return TGAColor();
 	}
-	return TGAColor(data + (x + y * width) * bytespp, bytespp);
+	unsigned char *p = data + (x + y * width) * bytespp;
+	switch (bytespp)
+	{
+	case GRAYSCALE:
+		return Image<Gray8>::decode(p);
+	case RGB:
+		return Image<RGB8>::decode(p);
+	default:
+		return Image<RGBA8>::decode(p);
+	}
 }
 
 bool TGAImage::set(int x, int y, TGAColor c)
@@ -328,7 +389,19 @@ bool TGAImage::set(int x, int y, TGAColor c)
 	{
 		return false;
 	}
-	memcpy(data + (x + y * width) * bytespp, c.raw, bytespp);
+	unsigned char *p = data + (x + y * width) * bytespp;
+	switch (bytespp)
+	{
+	case GRAYSCALE:
+		Image<Gray8>::encode(p, c);
+		break;
+	case RGB:
+		Image<RGB8>::encode(p, c);
+		break;
+	default:
+		Image<RGBA8>::encode(p, c);
+		break;
+	}
 	return true;
 }
 
@@ -351,17 +424,7 @@ bool TGAImage::flip_horizontally()
 {
 	if (!data)
 		return false;
-	int half = width >> 1;
-	for (int i = 0; i < half; i++)
-	{
-		for (int j = 0; j < height; j++)
-		{
-			TGAColor c1 = get(i, j);
-			TGAColor c2 = get(width - 1 - i, j);
-			set(i, j, c2);
-			set(width - 1 - i, j, c1);
-		}
-	}
+	imageops::flip_bytes_horizontally(data, width, height, bytespp);
 	return true;
 }
 
@@ -371,19 +434,15 @@ bool TGAImage::flip_vertically()
 		return false;
 
 	unsigned long bytes_per_line = width * bytespp;
-	unsigned char *line = new unsigned char[bytes_per_line];
 	int half = height >> 1;
 
+	// 两行原地交换, 每帧输出都会调用, 不分配临时行
 	for (int j = 0; j < half; j++)
 	{
-		unsigned long l1 = j * bytes_per_line;
-		unsigned long l2 = (height - 1 - j) * bytes_per_line;
-		memmove((void *)line, (void *)(data + l1), bytes_per_line);
-		memmove((void *)(data + l1), (void *)(data + l2), bytes_per_line);
-		memmove((void *)(data + l2), (void *)line, bytes_per_line);
+		unsigned char *l1 = data + j * bytes_per_line;
+		unsigned char *l2 = data + (height - 1 - j) * bytes_per_line;
+		std::swap_ranges(l1, l1 + bytes_per_line, l2);
 	}
-
-	delete[] line;
 	return true;
 }
 
@@ -394,48 +453,28 @@ unsigned char *TGAImage::buffer()
 
 void TGAImage::clear()
 {
-	memset((void *)data, 0, width * height * bytespp);
+	if (data)
+		memset((void *)data, 0, width * height * bytespp);
 }
 
+// 整数倍缩小用box滤波, 其余情况双线性插值
 bool TGAImage::scale(int w, int h)
 {
 	if (w <= 0 || h <= 0 || !data)
 		return false;
-	unsigned char *tdata = new unsigned char[w * h * bytespp];
-	int nscanline = 0;
-	int oscanline = 0;
-	int erry = 0;
-	unsigned long nlinebytes = w * bytespp;
-	unsigned long olinebytes = width * bytespp;
-	for (int j = 0; j < height; j++)
+	TGAImage scaled(w, h, bytespp);
+	switch (bytespp)
 	{
-		int errx = width - w;
-		int nx = -bytespp;
-		int ox = -bytespp;
-		for (int i = 0; i < width; i++)
-		{
-			ox += bytespp;
-			errx += w;
-			while (errx >= (int)width)
-			{
-				errx -= width;
-				nx += bytespp;
-				memcpy(tdata + nscanline + nx, data + oscanline + ox, bytespp);
-			}
-		}
-		erry += h;
-		oscanline += olinebytes;
-		while (erry >= (int)height)
-		{
-			if (erry >= (int)height << 1) // it means we jump over a scanline
-				memcpy(tdata + nscanline + nlinebytes, tdata + nscanline, nlinebytes);
-			erry -= height;
-			nscanline += nlinebytes;
-		}
+	case GRAYSCALE:
+		imageops::resample(as<Gray8>(), scaled.as<Gray8>());
+		break;
+	case RGB:
+		imageops::resample(as<RGB8>(), scaled.as<RGB8>());
+		break;
+	default:
+		imageops::resample(as<RGBA8>(), scaled.as<RGBA8>());
+		break;
 	}
-	delete[] data;
-	data = tdata;
-	width = w;
-	height = h;
+	*this = std::move(scaled);
 	return true;
 }